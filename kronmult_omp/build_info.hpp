@@ -0,0 +1,94 @@
+#pragma once
+#include "kronmult_dispatch.hpp"
+#include <string>
+
+/*
+ * describes the configuration kronmult was compiled with
+ * as this is a header-only library, it reflects the flags of the translation unit that includes it
+ */
+struct kronmult_build_info
+{
+    // is the batch parallelized with OpenMP
+    bool openmp;
+    // are the matrix products delegated to BLAS
+    bool blas;
+    // name of the backend used for the matrix products ("blas" or "native")
+    char const *backend;
+    // widest SIMD instruction set enabled at compile time
+    char const *simd;
+    // are the outputs of `kronmult_batched` reproducible whatever the number of threads
+    bool deterministic;
+    // number of threads cooperating on each large batch element of `kronmult_batched` (1 when teams are disabled)
+    int team_size;
+    // instruction set whose variant of the native kernels is used on this machine (picked at runtime)
+    char const *isa;
+};
+
+/*
+ * returns the widest SIMD instruction set that the compiler was allowed to use
+ */
+inline char const *kronmult_simd_level()
+{
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#elif defined(__AVX__)
+    return "avx";
+#elif defined(__SSE4_2__)
+    return "sse4.2";
+#elif defined(__SSE2__)
+    return "sse2";
+#elif defined(__ARM_FEATURE_SVE)
+    return "sve";
+#elif defined(__ARM_NEON)
+    return "neon";
+#else
+    return "none";
+#endif
+}
+
+/*
+ * returns the backends and SIMD level this library was built with
+ * this lets users check at runtime that they are not running a silently degraded build
+ */
+inline kronmult_build_info kronmult_get_build_info()
+{
+    kronmult_build_info info{};
+#ifdef _OPENMP
+    info.openmp = true;
+#else
+    info.openmp = false;
+#endif
+#ifdef KRONMULT_USE_BLAS
+    info.blas    = true;
+    info.backend = "blas";
+#else
+    info.blas    = false;
+    info.backend = "native";
+#endif
+    info.simd = kronmult_simd_level();
+#ifdef KRONMULT_DETERMINISTIC
+    info.deterministic = true;
+#else
+    info.deterministic = false;
+#endif
+#ifdef KRONMULT_TEAM_SIZE
+    info.team_size = KRONMULT_TEAM_SIZE;
+#else
+    info.team_size = 1;
+#endif
+    info.isa = kronmult_dispatched_isa();
+    return info;
+}
+
+/*
+ * returns a human readable description of the build configuration
+ */
+inline std::string kronmult_build_info_string()
+{
+    kronmult_build_info const info = kronmult_get_build_info();
+    return std::string("backend:") + info.backend + " openmp:" + (info.openmp ? "on" : "off")
+           + " simd:" + info.simd + " deterministic:" + (info.deterministic ? "on" : "off")
+           + " team_size:" + std::to_string(info.team_size) + " isa:" + info.isa;
+}
@@ -1,17 +1,69 @@
 #pragma once
+#include "build_info.hpp"
+#include "kronmult_lanes.hpp"
+#include "kronmult_teams.hpp"
+#include "kronmult_utils.hpp"
 #include "linear_algebra.hpp"
+#include <algorithm>
+#include <functional>
 #include <memory>
+#include <vector>
+#ifdef KRONMULT_ENABLE_CAPTURE
+#include "kronmult_capture.hpp"
+#endif
 
 /*
- * computes number^power for integers
- * does not care about performances
- * does not use std::pow as it does an implicit float conversion that could lead to rounding errors for large
- * numbers
+ * Computes kron(matrix_list) * input and returns a pointer to the result
+ *
+ * `matrix_list` is an array containing pointers to `matrix_number` square matrices of size `matrix_size` by
+ * `matrix_size` and stride `matrix_stride` `input` is a `size_input` (`matrix_size`^`matrix_number`) elements
+ * vector `workspace` and `workspace2` are `size_input` elements vectors, to be used as workspaces (the result
+ * will be stored in one of them) `transpose_workspace` is a vector of size `matrix_size`*`matrix_size` to
+ * store transposed matrices temporarily
+ *
+ * NOTE: `input` is only read, it can thus be passed as `workspace2` to save memory
+ * if `transposed` is true, computes kron(matrix_list)^T * input instead (without transposing the matrices in memory)
+ *
+ * WARNINGS:
+ * - `workspace`, `workspace2` and `transpose_workspace` will be used as temporary workspaces and thus modified
+ * - the matrices are assumed to be stored in col-major order
+ * - the sizes are assumed to be correct
  */
-int pow_int(int const number, int const power)
+template<typename T, bool transposed = false>
+T *kronmult_contract(int const matrix_count, int const matrix_size, T const *const matrix_list[],
+                     int const matrix_stride, T const input[], int const size_input, T workspace[],
+                     T workspace2[], T transpose_workspace[])
 {
-    if (power == 0) return 1;
-    return number * pow_int(number, power - 1);
+    // how many column should `input` have for the multiplications to be legal
+    int const nb_col_input = size_input / matrix_size;
+
+    // iterates on the matrices from last to first
+    T const *source  = input;
+    T *destination   = workspace;
+    T *other         = workspace2;
+    for (int i = matrix_count - 1; i >= 0; i--)
+    {
+        // takes `matrix` into account and put the result in `destination`
+        // kron(matrix_list)^T = kron(matrix_list^T)
+        T const *const matrix = matrix_list[i];
+        if constexpr (transposed)
+        {
+            multiply_transpose_X<T>(source, nb_col_input, matrix, matrix_size, matrix_stride, destination);
+        }
+        else
+        {
+            multiply_transpose<T>(source, nb_col_input, matrix, matrix_size, matrix_stride, destination,
+                                  transpose_workspace);
+        }
+        // the result becomes the input of the next multiplication
+        // note that, while they have the same size flattened, the shapes (numbers of columns and rows) of
+        // `source` and `destination` are different this is on purpose and equivalent to a reshape operation
+        // that is actually needed by the algorithm
+        source = destination;
+        std::swap(destination, other);
+    }
+
+    return const_cast<T *>(source);
 }
 
 /*
@@ -23,39 +75,202 @@ int pow_int(int const number, int const power)
  * `workspace` is a `size_input` elements vector, to be used as workspace
  * `transpose_workspace` is a vector of size `matrix_size`*`matrix_size` to store transposed matrices
  * temporarily
+ * if `transposed` is true, computes output += kron(matrix_list)^T * input instead
  *
  * WARNINGS:
  * - `input`, `workspace` and `transpose_workspace` will be used as temporary workspaces and thus modified
  * - the matrices are assumed to be stored in col-major order
  * - the sizes are assumed to be correct
  */
-template<typename T>
+template<typename T, bool transposed = false>
 void kronmult(int const matrix_count, int const matrix_size, T const *const matrix_list[],
               int const matrix_stride, T input[], int const size_input, T output[], T workspace[],
               T transpose_workspace[])
 {
-    // how many column should `input` have for the multiplications to be legal
-    int const nb_col_input = size_input / matrix_size;
+    // uses `input` as a second workspace
+    T const *const result = kronmult_contract<T, transposed>(
+        matrix_count, matrix_size, matrix_list, matrix_stride, input, size_input, workspace, input,
+        transpose_workspace);
 
-    // iterates on the matrices from last to first
-    for (int i = matrix_count - 1; i >= 0; i--)
+    // adds to output in a thread-safe way
+    atomic_add_vector(output, result, size_input);
+}
+
+/*
+ * serial version of `kronmult_batched`
+ * it does not spawn threads, does not allocate memory (past its first call) and does not use atomic additions
+ * (unless it is called from within a parallel region, where other threads might share its outputs)
+ */
+template<typename T, bool transposed = false>
+void kronmult_batched_serial(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                             int const matrix_stride, T *input_batched[], T *output_batched[],
+                             T *workspace_batched[], int const nb_batch)
+{
+    // numbers of elements in the input vector
+    int const size_input = pow_int(matrix_size, matrix_count);
+
+    // workspace that will be used to store matrix transpositions
+    T *const transpose_workspace = thread_workspace<T>(matrix_size * matrix_size);
+
+    // are other threads potentially writing to the outputs
+    bool const is_thread_safe = not is_in_parallel_region();
+
+    // computes kronmult for all batch elements
+    for (int i = 0; i < nb_batch; i++)
     {
-        // takes `matrix` into account and put the result in `workspace`
-        T const *const matrix = matrix_list[i];
-        multiply_transpose<T>(input, nb_col_input, matrix, matrix_size, matrix_stride, workspace,
-                              transpose_workspace);
-        // swap `input` and `workspace` such that `input` contains, once again, the input
-        // note that, while they have the same size flattened, the shapes (numbers of columns and rows) of
-        // `input` and `workspace` are different this is on purpose and equivalent to a reshape operation that
-        // is actually needed by the algorithm
-        std::swap(input, workspace);
+        T const *const *matrix_list = &matrix_list_batched[i * matrix_count];
+        T *input                    = input_batched[i];
+        T *output                   = output_batched[i];
+        T *workspace                = workspace_batched[i];
+        T const *const result = kronmult_contract<T, transposed>(
+            matrix_count, matrix_size, matrix_list, matrix_stride, input, size_input, workspace, input,
+            transpose_workspace);
+        if (is_thread_safe)
+        {
+            for (int j = 0; j < size_input; j++) output[j] += result[j];
+        }
+        else
+        {
+            atomic_add_vector(output, result, size_input);
+        }
     }
+}
+
+/*
+ * parallel version of `kronmult_batched`
+ * parallelizes over batch elements, using atomic additions to update the outputs
+ */
+template<typename T, bool transposed = false>
+void kronmult_batched_parallel(int const matrix_count, int const matrix_size,
+                               T const *const matrix_list_batched[], int const matrix_stride,
+                               T *input_batched[], T *output_batched[], T *workspace_batched[],
+                               int const nb_batch)
+{
+    // numbers of elements in the input vector
+    int const size_input = pow_int(matrix_size, matrix_count);
 
-    // adds to input in a thread-safe way
-    for (int i = 0; i < size_input; i++)
+    // paralelize over batch elements
+    #pragma omp parallel
     {
-        #pragma omp atomic
-        output[i] += input[i];
+        // workspace that will be used to store matrix transpositions
+        // only one per thread, reused from one call to the next
+        T *const transpose_workspace = thread_workspace<T>(matrix_size * matrix_size);
+
+        // computes kronmult for all batch elements
+        #pragma omp for
+        for (int i = 0; i < nb_batch; i++)
+        {
+            T const *const *matrix_list = &matrix_list_batched[i * matrix_count];
+            T *input                    = input_batched[i];
+            T *output                   = output_batched[i];
+            T *workspace                = workspace_batched[i];
+            kronmult<T, transposed>(matrix_count, matrix_size, matrix_list, matrix_stride, input, size_input,
+                                    output, workspace, transpose_workspace);
+        }
+    }
+}
+
+/*
+ * number of elements of an output summed by a single task in `kronmult_batched_deterministic`
+ * lets several threads share the summation of outputs that are shared by many batch elements
+ */
+#ifndef KRONMULT_DETERMINISTIC_BLOCK_SIZE
+#define KRONMULT_DETERMINISTIC_BLOCK_SIZE 1024
+#endif
+
+/*
+ * reproducible version of `kronmult_batched`
+ * its outputs are bitwise identical whatever the number of threads: the contributions to a given output are
+ * always added in increasing batch index order (as `kronmult_batched_serial` would do)
+ *
+ * the products are computed in parallel and left in the input or workspace of their batch element, they are
+ * then summed with a segmented reduction: the runs of consecutive batch elements sharing an output are sorted by
+ * output (and then by batch index) and each slice of an output is summed by a single thread, without atomics
+ *
+ * WARNINGS:
+ * - the input and workspace of a batch element should not be shared with another batch element
+ * - reproducibility also requires a BLAS whose results do not depend on the alignment of the data
+ * - the outputs should not be written to by a concurrent call
+ */
+template<typename T, bool transposed = false>
+void kronmult_batched_deterministic(int const matrix_count, int const matrix_size,
+                                    T const *const matrix_list_batched[], int const matrix_stride,
+                                    T *input_batched[], T *output_batched[], T *workspace_batched[],
+                                    int const nb_batch)
+{
+    // numbers of elements in the input vector
+    int const size_input = pow_int(matrix_size, matrix_count);
+
+    bool const is_parallel = kronmult_should_go_parallel(nb_batch, matrix_count, matrix_size);
+
+    // runs of consecutive batch elements sharing an output
+    struct output_run
+    {
+        T *output;
+        int first;
+        int last;
+    };
+    std::vector<output_run> runs;
+    for (int i = 0; i < nb_batch; i++)
+    {
+        T *const output = output_batched[i];
+        if (runs.empty() or (runs.back().output != output)) runs.push_back({output, i, i});
+        runs.back().last = i + 1;
+    }
+
+    // groups the runs by output, keeping them in batch order
+    // (batches produced by a sparse grid code are usually already grouped and have few runs to sort)
+    std::sort(runs.begin(), runs.end(), [](output_run const &a, output_run const &b) {
+        if (a.output != b.output) return std::less<T *>()(a.output, b.output);
+        return a.first < b.first;
+    });
+    std::vector<int> segment_starts;
+    for (int r = 0; r < static_cast<int>(runs.size()); r++)
+    {
+        if ((r == 0) or (runs[r].output != runs[r - 1].output)) segment_starts.push_back(r);
+    }
+    segment_starts.push_back(static_cast<int>(runs.size()));
+    int const nb_segments = static_cast<int>(segment_starts.size()) - 1;
+    int const block_size  = KRONMULT_DETERMINISTIC_BLOCK_SIZE;
+    int const nb_blocks   = (size_input + block_size - 1) / block_size;
+
+    // where the product of each batch element has been stored
+    std::vector<T const *> results(nb_batch);
+
+    #pragma omp parallel if (is_parallel)
+    {
+        // workspace that will be used to store matrix transpositions
+        T *const transpose_workspace = thread_workspace<T>(matrix_size * matrix_size);
+
+        // computes the products, the order does not matter as they are independent
+        #pragma omp for schedule(static)
+        for (int i = 0; i < nb_batch; i++)
+        {
+            T const *const *matrix_list = &matrix_list_batched[static_cast<size_t>(i) * matrix_count];
+            results[i]                  = kronmult_contract<T, transposed>(
+                matrix_count, matrix_size, matrix_list, matrix_stride, input_batched[i], size_input,
+                workspace_batched[i], input_batched[i], transpose_workspace);
+        }
+
+        // sums the products into the outputs, in batch order
+        #pragma omp for collapse(2) schedule(dynamic)
+        for (int s = 0; s < nb_segments; s++)
+        {
+            for (int b = 0; b < nb_blocks; b++)
+            {
+                int const begin = b * block_size;
+                int const end   = std::min(size_input, begin + block_size);
+                T *const output = runs[segment_starts[s]].output;
+                for (int r = segment_starts[s]; r < segment_starts[s + 1]; r++)
+                {
+                    for (int i = runs[r].first; i < runs[r].last; i++)
+                    {
+                        T const *const result = results[i];
+                        for (int j = begin; j < end; j++) output[j] += result[j];
+                    }
+                }
+            }
+        }
     }
 }
 
@@ -68,37 +283,88 @@ void kronmult(int const matrix_count, int const matrix_size, T const *const matr
  * pointers to array of size `matrix_size`^`matrix_count` `output_batched` is an array of `nb_batch` pointers
  * to array of size `matrix_size`^`matrix_count`, to which the outputs will be added `workspace` is an array
  * of `nb_batch` pointers to array of size `matrix_size`^`matrix_count`, to be used as workspaces
+ * if `transposed` is true, computes output[K] += kron(matrix_list[K])^T * input[K] instead
+ * (see `kronmult_batched_transposed`)
+ * if `KRONMULT_DETERMINISTIC` is defined, the outputs are bitwise reproducible
+ * (see `kronmult_batched_deterministic`)
+ * if `KRONMULT_TEAM_SIZE` is larger than 1, large products are processed by teams of threads
+ * (see `kronmult_batched_teams`)
  *
  * WARNINGS:
  * - `input_batched` and `workspace_batched` will be used as temporary workspaces and thus modified
  * - the matrices are assumed to be stored in col-major order
  * - the sizes are assumed to be correct
  */
-template<typename T>
+template<typename T, bool transposed = false>
 void kronmult_batched(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
                       int const matrix_stride, T *input_batched[], T *output_batched[],
                       T *workspace_batched[], int const nb_batch)
 {
-    // numbers of elements in the input vector
-    int const size_input = pow_int(matrix_size, matrix_count);
-
-    // paralelize over batch elements
-    #pragma omp parallel
+    // saves the inputs to disk for a later replay, see `kronmult_capture.hpp`
+    // (the capture format does not store transposition, transposed calls are thus not captured)
+    #ifdef KRONMULT_ENABLE_CAPTURE
+    if constexpr (not transposed)
     {
-        // workspace that will be used to store matrix transpositions
-        // only one, allocated once, per thread
-        std::unique_ptr<T[]> transpose_workspace(new T[matrix_size * matrix_size]);
+        kronmult_capture_hook<T>(matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched,
+                                 output_batched, nb_batch);
+    }
+    #endif
 
-        // computes kronmult for all batch elements
-        #pragma omp for
-        for (int i = 0; i < nb_batch; i++)
-        {
-            T const *const *matrix_list = &matrix_list_batched[i * matrix_count];
-            T *input                    = input_batched[i];
-            T *output                   = output_batched[i];
-            T *workspace                = workspace_batched[i];
-            kronmult<T>(matrix_count, matrix_size, matrix_list, matrix_stride, input, size_input, output,
-                        workspace, transpose_workspace.get());
-        }
+    // the other implementations add their contributions in an order that depends on the number of threads
+    #ifdef KRONMULT_DETERMINISTIC
+    kronmult_batched_deterministic<T, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride,
+                                                  input_batched, output_batched, workspace_batched, nb_batch);
+    return;
+    #endif
+
+    int const size_input   = pow_int(matrix_size, matrix_count);
+    bool const is_parallel = kronmult_should_go_parallel(nb_batch, matrix_count, matrix_size);
+
+    // very small products are vectorized across batch elements
+    bool const use_lanes = size_input <= KRONMULT_LANES_MAX_SIZE;
+
+    // large products can be shared by teams of threads, see `kronmult_teams.hpp`
+    bool const use_teams = (KRONMULT_TEAM_SIZE > 1) and (size_input >= KRONMULT_TEAM_MIN_SIZE);
+
+    if (use_lanes and is_parallel)
+    {
+        kronmult_batched_lanes_parallel<T, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride,
+                                        input_batched, output_batched, workspace_batched, nb_batch);
+    }
+    else if (use_lanes)
+    {
+        kronmult_batched_lanes_serial<T, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride,
+                                      input_batched, output_batched, workspace_batched, nb_batch);
+    }
+    else if (use_teams and is_parallel)
+    {
+        kronmult_batched_teams<T, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride,
+                                              input_batched, output_batched, workspace_batched, nb_batch);
+    }
+    else if (is_parallel)
+    {
+        kronmult_batched_parallel<T, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched,
+                                  output_batched, workspace_batched, nb_batch);
+    }
+    else
+    {
+        kronmult_batched_serial<T, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched,
+                                output_batched, workspace_batched, nb_batch);
     }
 }
+
+/*
+ * Computes output[K] += kron(matrix_list[K])^T * input[K] for 0 <= k < batchCount
+ * as needed by implicit time stepping and adjoint solves
+ *
+ * takes the same arguments as `kronmult_batched`, the matrices are read transposed in place: no transposed copy of
+ * the matrices or of the pointer arrays is made
+ */
+template<typename T>
+void kronmult_batched_transposed(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                                 int const matrix_stride, T *input_batched[], T *output_batched[],
+                                 T *workspace_batched[], int const nb_batch)
+{
+    kronmult_batched<T, true>(matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched,
+                              output_batched, workspace_batched, nb_batch);
+}
@@ -0,0 +1,257 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/*
+ * Aligned memory and arena allocation
+ *
+ * allocated with `new`, the vectors and workspaces used by kronmult are only 16-byte aligned (which splits SIMD
+ * loads across cache lines) and backed by 4 KB pages (which causes TLB misses once the working set reaches several
+ * GB)
+ * the functions of this file return memory aligned on `KRONMULT_ALIGNMENT` bytes and back large allocations with
+ * 2 MB huge pages when the system allows it
+ */
+
+// alignment, in bytes, of the memory returned by `kronmult_allocate` (a cache line and an AVX-512 register)
+#ifndef KRONMULT_ALIGNMENT
+#define KRONMULT_ALIGNMENT 64
+#endif
+
+// size of a huge page, allocations of at least that many bytes are mapped directly and can use huge pages
+#define KRONMULT_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// default size of the blocks of a `kronmult_arena`
+#ifndef KRONMULT_ARENA_BLOCK_SIZE
+#define KRONMULT_ARENA_BLOCK_SIZE (32 * KRONMULT_HUGE_PAGE_SIZE)
+#endif
+
+/*
+ * how large allocations are backed by huge pages
+ * - `none`: regular pages
+ * - `transparent`: regular pages that the kernel is advised to merge into huge pages (this requires
+ *   /sys/kernel/mm/transparent_hugepage/enabled to be set to `madvise` or `always`)
+ * - `preallocated`: pages taken from the pool of huge pages reserved by the system (see /proc/sys/vm/nr_hugepages)
+ *   falls back to `transparent` when the pool is empty
+ * huge pages are only available on Linux, other systems use regular pages
+ */
+enum class kronmult_huge_pages
+{
+    none,
+    transparent,
+    preallocated
+};
+
+/*
+ * rounds `size` up to a multiple of `alignment`
+ */
+inline std::size_t kronmult_round_up(std::size_t const size, std::size_t const alignment)
+{
+    return ((size + alignment - 1) / alignment) * alignment;
+}
+
+/*
+ * returns at least `bytes` bytes of memory aligned on `KRONMULT_ALIGNMENT` bytes
+ * allocations of at least `KRONMULT_HUGE_PAGE_SIZE` bytes are mapped directly, aligned on a huge page, and backed
+ * by huge pages following `huge_pages`
+ * throws `std::bad_alloc` if the memory cannot be allocated
+ *
+ * WARNING: the memory is not initialized and must be released with `kronmult_free`, passing the same size
+ */
+inline void *kronmult_allocate(std::size_t const bytes,
+                               kronmult_huge_pages const huge_pages = kronmult_huge_pages::transparent)
+{
+#ifdef __linux__
+    if (bytes >= KRONMULT_HUGE_PAGE_SIZE)
+    {
+        std::size_t const size = kronmult_round_up(bytes, KRONMULT_HUGE_PAGE_SIZE);
+        int const protection   = PROT_READ | PROT_WRITE;
+        int const flags        = MAP_PRIVATE | MAP_ANONYMOUS;
+        if (huge_pages == kronmult_huge_pages::preallocated)
+        {
+            void *const memory = mmap(nullptr, size, protection, flags | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) return memory;
+        }
+
+        // maps an extra huge page and trims the mapping such that it starts on a huge page boundary
+        // (transparent huge pages can only back the huge pages that are entirely within the mapping)
+        std::size_t const mapped_size = size + KRONMULT_HUGE_PAGE_SIZE;
+        void *const mapping           = mmap(nullptr, mapped_size, protection, flags, -1, 0);
+        if (mapping == MAP_FAILED) throw std::bad_alloc();
+        std::uintptr_t const start   = reinterpret_cast<std::uintptr_t>(mapping);
+        std::uintptr_t const aligned = kronmult_round_up(start, KRONMULT_HUGE_PAGE_SIZE);
+        if (aligned > start) munmap(mapping, aligned - start);
+        std::size_t const tail = (start + mapped_size) - (aligned + size);
+        if (tail > 0) munmap(reinterpret_cast<void *>(aligned + size), tail);
+
+        void *const memory = reinterpret_cast<void *>(aligned);
+        if (huge_pages != kronmult_huge_pages::none) madvise(memory, size, MADV_HUGEPAGE);
+        return memory;
+    }
+#endif
+    return ::operator new(kronmult_round_up(bytes, KRONMULT_ALIGNMENT), std::align_val_t(KRONMULT_ALIGNMENT));
+}
+
+/*
+ * releases memory allocated with `kronmult_allocate`, `bytes` being the size that was requested
+ */
+inline void kronmult_free(void *const memory, std::size_t const bytes)
+{
+    if (memory == nullptr) return;
+#ifdef __linux__
+    if (bytes >= KRONMULT_HUGE_PAGE_SIZE)
+    {
+        munmap(memory, kronmult_round_up(bytes, KRONMULT_HUGE_PAGE_SIZE));
+        return;
+    }
+#endif
+    ::operator delete(memory, std::align_val_t(KRONMULT_ALIGNMENT));
+}
+
+/*
+ * deleter letting a `std::unique_ptr` own memory allocated with `kronmult_allocate`
+ */
+struct kronmult_aligned_deleter
+{
+    std::size_t bytes;
+
+    void operator()(void *const memory) const { kronmult_free(memory, bytes); }
+};
+
+// uninitialized array of arithmetic types or pointers, allocated with `kronmult_allocate`
+template<typename T>
+using kronmult_aligned_array = std::unique_ptr<T[], kronmult_aligned_deleter>;
+
+/*
+ * allocates an uninitialized array of `count` elements with `kronmult_allocate`
+ * unlike a `std::vector`, the elements are not touched such that they can be first touched by the threads that
+ * will use them
+ */
+template<typename T>
+kronmult_aligned_array<T> kronmult_make_aligned_array(std::size_t const count,
+                                                      kronmult_huge_pages const huge_pages
+                                                      = kronmult_huge_pages::transparent)
+{
+    std::size_t const bytes = count * sizeof(T);
+    return kronmult_aligned_array<T>(static_cast<T *>(kronmult_allocate(bytes, huge_pages)),
+                                     kronmult_aligned_deleter{bytes});
+}
+
+/*
+ * standard allocator using `kronmult_allocate`, to get aligned `std::vector`s
+ */
+template<typename T>
+struct kronmult_aligned_allocator
+{
+    using value_type = T;
+
+    kronmult_aligned_allocator() = default;
+
+    template<typename U>
+    kronmult_aligned_allocator(kronmult_aligned_allocator<U> const &)
+    {
+    }
+
+    T *allocate(std::size_t const count) { return static_cast<T *>(kronmult_allocate(count * sizeof(T))); }
+
+    void deallocate(T *const memory, std::size_t const count) { kronmult_free(memory, count * sizeof(T)); }
+
+    template<typename U>
+    bool operator==(kronmult_aligned_allocator<U> const &) const
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(kronmult_aligned_allocator<U> const &) const
+    {
+        return false;
+    }
+};
+
+/*
+ * arena handing out aligned memory from a few large blocks
+ *
+ * the memory is released all at once, either by `reset` (which keeps the blocks to serve the next allocations) or
+ * by the destructor: the vectors and workspaces of a batch can thus be allocated together, and reused from one
+ * call to the next, without paying for page faults and TLB misses on millions of small allocations
+ *
+ * WARNINGS:
+ * - the memory is not initialized and no constructor or destructor is called, it is meant for arithmetic types and
+ *   pointers
+ * - the arena is not thread-safe
+ */
+class kronmult_arena
+{
+  public:
+    explicit kronmult_arena(std::size_t const block_size = KRONMULT_ARENA_BLOCK_SIZE,
+                            kronmult_huge_pages const huge_pages = kronmult_huge_pages::transparent)
+        : block_size(block_size), huge_pages(huge_pages)
+    {
+    }
+
+    kronmult_arena(kronmult_arena const &) = delete;
+    kronmult_arena &operator=(kronmult_arena const &) = delete;
+
+    ~kronmult_arena()
+    {
+        for (block const &b : blocks) kronmult_free(b.memory, b.size);
+    }
+
+    /*
+     * returns an array of `count` elements aligned on `KRONMULT_ALIGNMENT` bytes
+     * allocates a new block if none of the remaining ones has enough room
+     */
+    template<typename T>
+    T *allocate(std::size_t const count)
+    {
+        std::size_t const bytes = kronmult_round_up(count * sizeof(T), KRONMULT_ALIGNMENT);
+        while ((current < blocks.size()) and (blocks[current].used + bytes > blocks[current].size)) current++;
+        if (current == blocks.size())
+        {
+            std::size_t const size = std::max(block_size, bytes);
+            blocks.push_back({static_cast<char *>(kronmult_allocate(size, huge_pages)), size, 0});
+        }
+        block &b        = blocks[current];
+        T *const result = reinterpret_cast<T *>(b.memory + b.used);
+        b.used += bytes;
+        return result;
+    }
+
+    /*
+     * invalidates all the memory handed out so far, the blocks are kept and reused by the next allocations
+     */
+    void reset()
+    {
+        for (block &b : blocks) b.used = 0;
+        current = 0;
+    }
+
+    // number of bytes currently reserved by the arena
+    std::size_t capacity() const
+    {
+        std::size_t total = 0;
+        for (block const &b : blocks) total += b.size;
+        return total;
+    }
+
+  private:
+    struct block
+    {
+        char *memory;
+        std::size_t size;
+        std::size_t used;
+    };
+
+    std::size_t block_size;
+    kronmult_huge_pages huge_pages;
+    std::vector<block> blocks;
+    // index of the block currently used for allocations
+    std::size_t current = 0;
+};
@@ -0,0 +1,212 @@
+#pragma once
+#include "kronmult.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * handle on an asynchronous kronmult computation
+ * call `wait()` (or `get()` to rethrow a potential exception) to block until the computation is over
+ */
+using kronmult_handle = std::shared_future<void>;
+
+/*
+ * persistent worker running the batches submitted with `kronmult_batched_async`
+ *
+ * a single background thread owns an OpenMP team (which the OpenMP runtime keeps alive between parallel
+ * regions) when it wakes up, it takes *all* the batches that have been submitted so far and processes them
+ * within a single parallel region, the threads being load-balanced over the elements of all the batches
+ */
+class kronmult_worker
+{
+  public:
+    // processes the batch elements in [first; last) of a job
+    using range_function = std::function<void(int first, int last)>;
+
+    kronmult_worker() : worker_thread(&kronmult_worker::run, this) {}
+
+    // finishes the pending work and stops the background thread
+    ~kronmult_worker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            should_stop = true;
+        }
+        condition.notify_one();
+        worker_thread.join();
+    }
+
+    kronmult_worker(kronmult_worker const &) = delete;
+    kronmult_worker &operator=(kronmult_worker const &) = delete;
+
+    // queues a job of `nb_elements` elements and returns a handle that will be ready once it is computed
+    kronmult_handle submit(int const nb_elements, range_function function)
+    {
+        auto job = std::make_unique<Job>();
+        job->nb_elements = nb_elements;
+        job->function    = std::move(function);
+        kronmult_handle handle = job->promise.get_future().share();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending_jobs.push_back(std::move(job));
+        }
+        condition.notify_one();
+        return handle;
+    }
+
+  private:
+    struct Job
+    {
+        int nb_elements;
+        range_function function;
+        std::promise<void> promise;
+        std::exception_ptr error;
+    };
+
+    // slice of a job that will be processed by a single thread
+    struct Task
+    {
+        Job *job;
+        int first;
+        int last;
+    };
+
+    // waits for jobs and processes them until the worker is destroyed
+    void run()
+    {
+        while (true)
+        {
+            std::vector<std::unique_ptr<Job>> jobs;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return should_stop or not pending_jobs.empty(); });
+                if (pending_jobs.empty()) return; // should_stop and no work left
+                std::swap(jobs, pending_jobs);
+            }
+            process(jobs);
+        }
+    }
+
+    // computes all the given jobs in a single parallel region and fulfils their promises
+    static void process(std::vector<std::unique_ptr<Job>> &jobs)
+    {
+        // cuts the jobs into tasks, several per thread for load balancing
+        #ifdef _OPENMP
+        int const nb_threads = omp_get_max_threads();
+        #else
+        int const nb_threads = 1;
+        #endif
+        std::vector<Task> tasks;
+        for (auto &job : jobs)
+        {
+            int const task_size = std::max(1, job->nb_elements / (4 * nb_threads));
+            for (int first = 0; first < job->nb_elements; first += task_size)
+            {
+                tasks.push_back({job.get(), first, std::min(first + task_size, job->nb_elements)});
+            }
+        }
+
+        // runs the tasks, storing potential exceptions as they cannot leave the parallel region
+        int const nb_tasks = static_cast<int>(tasks.size());
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int t = 0; t < nb_tasks; t++)
+        {
+            Task const &task = tasks[t];
+            try
+            {
+                task.job->function(task.first, task.last);
+            }
+            catch (...)
+            {
+                #pragma omp critical(kronmult_worker_error)
+                if (not task.job->error) task.job->error = std::current_exception();
+            }
+        }
+
+        // signals the completion of the jobs
+        for (auto &job : jobs)
+        {
+            if (job->error) job->promise.set_exception(job->error);
+            else job->promise.set_value();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::unique_ptr<Job>> pending_jobs;
+    bool should_stop = false;
+    // declared last such that the other members are initialized before the thread starts
+    std::thread worker_thread;
+};
+
+/*
+ * returns the worker shared by all asynchronous calls
+ * it is created on first use and lives until the end of the program
+ */
+inline kronmult_worker &kronmult_get_worker()
+{
+    static kronmult_worker worker;
+    return worker;
+}
+
+/*
+ * Asynchronous version of `kronmult_batched`:
+ * queues the computation of output[K] += kron(matrix_list[K]) * input[K] for 0 <= k < batchCount
+ * and returns immediately with a handle that will be ready once the computation is over
+ *
+ * batches submitted before the worker wakes up are processed together, in a single parallel region, such
+ * that several independent batches (for example several PDE terms) can be submitted and then waited for
+ * several batches may write to the same outputs as the additions are thread-safe
+ *
+ * WARNINGS:
+ * - all arrays (including the arrays of pointers) must stay alive, and should not be touched, until the
+ *   handle is ready
+ * - the computation runs on its own OpenMP team, other parallel work done by the caller in the meantime will
+ *   share the cores with it
+ * - see `kronmult_batched` for the other assumptions on the inputs
+ */
+template<typename T>
+kronmult_handle kronmult_batched_async(int const matrix_count, int const matrix_size,
+                                       T const *const matrix_list_batched[], int const matrix_stride,
+                                       T *input_batched[], T *output_batched[], T *workspace_batched[],
+                                       int const nb_batch)
+{
+    // numbers of elements in the input vector
+    int const size_input = pow_int(matrix_size, matrix_count);
+
+    // computes kronmult for a range of batch elements
+    auto range_function = [=](int const first, int const last) {
+        // workspace that will be used to store matrix transpositions
+        T *const transpose_workspace = thread_workspace<T>(matrix_size * matrix_size);
+        for (int i = first; i < last; i++)
+        {
+            T const *const *matrix_list = &matrix_list_batched[i * matrix_count];
+            T *input                    = input_batched[i];
+            T *output                   = output_batched[i];
+            T *workspace                = workspace_batched[i];
+            kronmult<T>(matrix_count, matrix_size, matrix_list, matrix_stride, input, size_input, output,
+                        workspace, transpose_workspace);
+        }
+    };
+
+    return kronmult_get_worker().submit(nb_batch, range_function);
+}
+
+/*
+ * waits for all the given handles to be ready
+ * rethrows the first exception encountered, if any
+ */
+inline void kronmult_wait_all(std::vector<kronmult_handle> const &handles)
+{
+    for (auto const &handle : handles) handle.wait();
+    for (auto const &handle : handles) handle.get();
+}
@@ -0,0 +1,345 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * On-disk format storing the inputs of a single `kronmult_batched` call
+ *
+ * layout (all offsets in bytes from the beginning of the file, sections aligned on `kronmult_file_alignment`):
+ * - a `kronmult_file_header`
+ * - `nb_batch`*`matrix_count` int64 indices into the matrices section
+ * - `nb_batch` int64 indices into the inputs section
+ * - `nb_batch` int64 indices into the outputs section
+ * - `nb_matrices` deduplicated matrices of `matrix_size`*`matrix_size` elements (col-major, stride `matrix_size`)
+ * - `nb_inputs` deduplicated input vectors of `matrix_size`^`matrix_count` elements
+ * - `nb_outputs` deduplicated output vectors of `matrix_size`^`matrix_count` elements
+ *
+ * deduplication is done on the pointers, such that the sharing of matrices and the aliasing of outputs are kept
+ */
+constexpr char kronmult_file_magic[8] = {'K', 'R', 'O', 'N', 'M', 'U', 'L', 'T'};
+constexpr std::uint32_t kronmult_file_version = 1;
+constexpr std::uint64_t kronmult_file_alignment = 64;
+
+struct kronmult_file_header
+{
+    char magic[8];
+    std::uint32_t version;
+    // size in bytes of a scalar (4 for float, 8 for double)
+    std::uint32_t scalar_size;
+    std::int64_t matrix_count;
+    std::int64_t matrix_size;
+    std::int64_t nb_batch;
+    std::int64_t nb_matrices;
+    std::int64_t nb_inputs;
+    std::int64_t nb_outputs;
+    // offsets of the sections
+    std::int64_t matrix_indices_offset;
+    std::int64_t input_indices_offset;
+    std::int64_t output_indices_offset;
+    std::int64_t matrices_offset;
+    std::int64_t inputs_offset;
+    std::int64_t outputs_offset;
+    std::int64_t file_size;
+};
+
+/*
+ * rounds `offset` up to the next multiple of `kronmult_file_alignment`
+ */
+inline std::int64_t kronmult_file_align(std::int64_t const offset)
+{
+    std::int64_t const alignment = kronmult_file_alignment;
+    return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+/*
+ * gives an index to each distinct pointer, in order of first appearance
+ * stores the indices in `indices` and the distinct pointers in `distinct`
+ */
+template<typename P>
+void kronmult_deduplicate(P const pointers[], std::int64_t const nb_pointers, std::vector<std::int64_t> &indices,
+                          std::vector<P> &distinct)
+{
+    std::unordered_map<P, std::int64_t> index_of;
+    indices.resize(nb_pointers);
+    for (std::int64_t i = 0; i < nb_pointers; i++)
+    {
+        auto const inserted = index_of.emplace(pointers[i], static_cast<std::int64_t>(distinct.size()));
+        if (inserted.second) distinct.push_back(pointers[i]);
+        indices[i] = inserted.first->second;
+    }
+}
+
+/*
+ * Captures the inputs of a `kronmult_batched` call into the file at `path`
+ *
+ * call it *before* `kronmult_batched` as the inputs are modified by the computation
+ * the outputs are stored with their current content
+ * throws an std::runtime_error if the file cannot be written
+ */
+template<typename T>
+void kronmult_capture(std::string const &path, int const matrix_count, int const matrix_size,
+                      T const *const matrix_list_batched[], int const matrix_stride,
+                      T const *const input_batched[], T const *const output_batched[], int const nb_batch)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "kronmult_capture requires a trivially copyable type");
+    std::int64_t size_input = 1;
+    for (int d = 0; d < matrix_count; d++) size_input *= matrix_size;
+    std::int64_t const size_matrix = static_cast<std::int64_t>(matrix_size) * matrix_size;
+
+    // deduplicates the pointers
+    std::vector<std::int64_t> matrix_indices, input_indices, output_indices;
+    std::vector<T const *> matrices, inputs, outputs;
+    kronmult_deduplicate(matrix_list_batched, static_cast<std::int64_t>(nb_batch) * matrix_count, matrix_indices,
+                         matrices);
+    kronmult_deduplicate(input_batched, nb_batch, input_indices, inputs);
+    kronmult_deduplicate(output_batched, nb_batch, output_indices, outputs);
+
+    // builds the header
+    kronmult_file_header header{};
+    std::memcpy(header.magic, kronmult_file_magic, sizeof(header.magic));
+    header.version               = kronmult_file_version;
+    header.scalar_size           = sizeof(T);
+    header.matrix_count          = matrix_count;
+    header.matrix_size           = matrix_size;
+    header.nb_batch              = nb_batch;
+    header.nb_matrices           = matrices.size();
+    header.nb_inputs             = inputs.size();
+    header.nb_outputs            = outputs.size();
+    header.matrix_indices_offset = kronmult_file_align(sizeof(kronmult_file_header));
+    header.input_indices_offset  = kronmult_file_align(header.matrix_indices_offset
+                                                       + matrix_indices.size() * sizeof(std::int64_t));
+    header.output_indices_offset = kronmult_file_align(header.input_indices_offset
+                                                       + input_indices.size() * sizeof(std::int64_t));
+    header.matrices_offset       = kronmult_file_align(header.output_indices_offset
+                                                       + output_indices.size() * sizeof(std::int64_t));
+    header.inputs_offset  = kronmult_file_align(header.matrices_offset + header.nb_matrices * size_matrix * sizeof(T));
+    header.outputs_offset = kronmult_file_align(header.inputs_offset + header.nb_inputs * size_input * sizeof(T));
+    header.file_size      = header.outputs_offset + header.nb_outputs * size_input * sizeof(T);
+
+    // writes the file, padding the sections with zeros
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (not file) throw std::runtime_error("kronmult_capture: cannot open '" + path + "'");
+    auto write_at = [&](std::int64_t const offset, void const *data, std::int64_t const nb_bytes) {
+        static char const padding[kronmult_file_alignment] = {};
+        std::int64_t position = file.tellp();
+        while (position < offset)
+        {
+            std::int64_t const nb_padding = std::min<std::int64_t>(offset - position, sizeof(padding));
+            file.write(padding, nb_padding);
+            position += nb_padding;
+        }
+        file.write(static_cast<char const *>(data), nb_bytes);
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(header.matrix_indices_offset, matrix_indices.data(), matrix_indices.size() * sizeof(std::int64_t));
+    write_at(header.input_indices_offset, input_indices.data(), input_indices.size() * sizeof(std::int64_t));
+    write_at(header.output_indices_offset, output_indices.data(), output_indices.size() * sizeof(std::int64_t));
+    // the matrices are compacted to a stride of `matrix_size`
+    std::int64_t offset = header.matrices_offset;
+    for (T const *matrix : matrices)
+    {
+        for (int col = 0; col < matrix_size; col++)
+        {
+            write_at(offset, &matrix[static_cast<std::int64_t>(col) * matrix_stride], matrix_size * sizeof(T));
+            offset += matrix_size * sizeof(T);
+        }
+    }
+    offset = header.inputs_offset;
+    for (T const *input : inputs)
+    {
+        write_at(offset, input, size_input * sizeof(T));
+        offset += size_input * sizeof(T);
+    }
+    offset = header.outputs_offset;
+    for (T const *output : outputs)
+    {
+        write_at(offset, output, size_input * sizeof(T));
+        offset += size_input * sizeof(T);
+    }
+    if (not file) throw std::runtime_error("kronmult_capture: failed to write '" + path + "'");
+}
+
+/*
+ * Capture hook called by `kronmult_batched` when `KRONMULT_ENABLE_CAPTURE` is defined
+ *
+ * if the `KRONMULT_CAPTURE_FILE` environment variable is set, the first `KRONMULT_CAPTURE_COUNT` (defaults to 1)
+ * calls are captured into the files `$KRONMULT_CAPTURE_FILE.0`, `$KRONMULT_CAPTURE_FILE.1`, etc.
+ */
+template<typename T>
+void kronmult_capture_hook(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                           int const matrix_stride, T const *const input_batched[],
+                           T const *const output_batched[], int const nb_batch)
+{
+    static char const *const path = std::getenv("KRONMULT_CAPTURE_FILE");
+    if (path == nullptr) return;
+    static char const *const count_string = std::getenv("KRONMULT_CAPTURE_COUNT");
+    static int const max_count = (count_string == nullptr) ? 1 : std::atoi(count_string);
+    static std::atomic<int> call_count{0};
+    int const call_index = call_count++;
+    if (call_index >= max_count) return;
+    kronmult_capture(std::string(path) + "." + std::to_string(call_index), matrix_count, matrix_size,
+                     matrix_list_batched, matrix_stride, input_batched, output_batched, nb_batch);
+}
+
+/*
+ * Loads a file written by `kronmult_capture` and exposes it as the inputs of a `kronmult_batched` call
+ *
+ * the file is memory-mapped privately: the data is read lazily from the disk and never copied unless it is modified
+ * (copy-on-write) such that the file itself is never modified only the arrays of pointers are built on load
+ *
+ * throws an std::runtime_error if the file cannot be mapped, does not match the type `T` or if its header, sections
+ * or indices are inconsistent with its size (truncated or corrupted file), before building any pointer
+ */
+template<typename T>
+class kronmult_problem_file
+{
+  public:
+    int matrix_count;
+    int matrix_size;
+    // matrices are stored compactly
+    int matrix_stride;
+    int size_input;
+    int nb_batch;
+    // statistics on the sharing within the batch
+    std::int64_t nb_matrices;
+    std::int64_t nb_inputs;
+    std::int64_t nb_outputs;
+    // arrays of pointers into the mapped file, as expected by `kronmult_batched`
+    std::vector<T const *> matrix_list_batched;
+    std::vector<T *> input_batched;
+    std::vector<T *> output_batched;
+
+    explicit kronmult_problem_file(std::string const &path)
+    {
+        // maps the file
+        int const fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("kronmult_problem_file: cannot open '" + path + "'");
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 or file_stat.st_size < static_cast<off_t>(sizeof(kronmult_file_header)))
+        {
+            close(fd);
+            throw std::runtime_error("kronmult_problem_file: '" + path + "' is not a kronmult file");
+        }
+        mapping_size = file_stat.st_size;
+        mapping      = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) throw std::runtime_error("kronmult_problem_file: cannot map '" + path + "'");
+
+        // unmaps the file before reporting an invalid content
+        auto fail = [&](std::string const &message) {
+            munmap(mapping, mapping_size);
+            throw std::runtime_error("kronmult_problem_file: " + message);
+        };
+
+        // checks the header
+        kronmult_file_header const &header = *static_cast<kronmult_file_header const *>(mapping);
+        if (std::memcmp(header.magic, kronmult_file_magic, sizeof(header.magic)) != 0
+            or header.version != kronmult_file_version or header.file_size != mapping_size)
+        {
+            fail("'" + path + "' is not a valid kronmult file");
+        }
+        if (header.scalar_size != sizeof(T)) fail("'" + path + "' was captured with another precision");
+
+        // checks the sizes, such that the products below cannot overflow
+        std::int64_t const max_int = std::numeric_limits<int>::max();
+        if ((header.matrix_count < 1) or (header.matrix_size < 1) or (header.matrix_size > max_int)
+            or (header.nb_batch < 0) or (header.nb_batch > max_int) or (header.nb_matrices < 0)
+            or (header.nb_inputs < 0) or (header.nb_outputs < 0))
+        {
+            fail("'" + path + "' has invalid sizes");
+        }
+        if ((header.matrix_count > max_int / std::max<std::int64_t>(1, header.nb_batch))
+            or (header.matrix_size > max_int / header.matrix_size))
+        {
+            fail("'" + path + "' has invalid sizes");
+        }
+        std::int64_t size_input_64 = 1;
+        for (std::int64_t d = 0; (d < header.matrix_count) and (header.matrix_size > 1); d++)
+        {
+            if (size_input_64 > max_int / header.matrix_size) fail("'" + path + "' has invalid sizes");
+            size_input_64 *= header.matrix_size;
+        }
+        matrix_count  = header.matrix_count;
+        matrix_size   = header.matrix_size;
+        matrix_stride = header.matrix_size;
+        size_input    = size_input_64;
+        nb_batch      = header.nb_batch;
+        nb_matrices   = header.nb_matrices;
+        nb_inputs     = header.nb_inputs;
+        nb_outputs    = header.nb_outputs;
+
+        // checks that each section, of `count` elements of `element_size` bytes, lies within the file
+        auto check_section = [&](std::int64_t const offset, std::int64_t const count,
+                                 std::int64_t const element_size) {
+            if ((offset < static_cast<std::int64_t>(sizeof(kronmult_file_header))) or (offset > mapping_size)
+                or (offset % kronmult_file_alignment != 0) or (count > (mapping_size - offset) / element_size))
+            {
+                fail("'" + path + "' is truncated or corrupted");
+            }
+        };
+        std::int64_t const size_matrix = static_cast<std::int64_t>(matrix_size) * matrix_size;
+        std::int64_t const nb_matrix_indices = static_cast<std::int64_t>(nb_batch) * matrix_count;
+        check_section(header.matrix_indices_offset, nb_matrix_indices, sizeof(std::int64_t));
+        check_section(header.input_indices_offset, nb_batch, sizeof(std::int64_t));
+        check_section(header.output_indices_offset, nb_batch, sizeof(std::int64_t));
+        check_section(header.matrices_offset, nb_matrices, size_matrix * sizeof(T));
+        check_section(header.inputs_offset, nb_inputs, size_input * sizeof(T));
+        check_section(header.outputs_offset, nb_outputs, size_input * sizeof(T));
+
+        // checks that the indices refer to stored matrices and vectors
+        char *const base = static_cast<char *>(mapping);
+        auto matrix_indices = reinterpret_cast<std::int64_t const *>(base + header.matrix_indices_offset);
+        auto input_indices  = reinterpret_cast<std::int64_t const *>(base + header.input_indices_offset);
+        auto output_indices = reinterpret_cast<std::int64_t const *>(base + header.output_indices_offset);
+        auto check_indices  = [&](std::int64_t const indices[], std::int64_t const count, std::int64_t const bound) {
+            for (std::int64_t i = 0; i < count; i++)
+            {
+                if ((indices[i] < 0) or (indices[i] >= bound)) fail("'" + path + "' contains invalid indices");
+            }
+        };
+        check_indices(matrix_indices, nb_matrix_indices, nb_matrices);
+        check_indices(input_indices, nb_batch, nb_inputs);
+        check_indices(output_indices, nb_batch, nb_outputs);
+
+        // rebuilds the arrays of pointers
+        auto matrices = reinterpret_cast<T const *>(base + header.matrices_offset);
+        auto inputs   = reinterpret_cast<T *>(base + header.inputs_offset);
+        auto outputs  = reinterpret_cast<T *>(base + header.outputs_offset);
+        matrix_list_batched.resize(nb_matrix_indices);
+        for (std::size_t i = 0; i < matrix_list_batched.size(); i++)
+        {
+            matrix_list_batched[i] = matrices + matrix_indices[i] * size_matrix;
+        }
+        input_batched.resize(nb_batch);
+        output_batched.resize(nb_batch);
+        for (int i = 0; i < nb_batch; i++)
+        {
+            input_batched[i]  = inputs + input_indices[i] * size_input;
+            output_batched[i] = outputs + output_indices[i] * size_input;
+        }
+    }
+
+    // unmaps the file, discarding any modification
+    ~kronmult_problem_file() { munmap(mapping, mapping_size); }
+
+    kronmult_problem_file(kronmult_problem_file const &) = delete;
+    kronmult_problem_file &operator=(kronmult_problem_file const &) = delete;
+
+  private:
+    void *mapping;
+    std::int64_t mapping_size;
+};
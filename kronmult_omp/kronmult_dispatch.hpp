@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Runtime dispatch of the native kernels on the instruction set of the CPU
+ *
+ * a binary deployed on heterogeneous nodes has to be compiled for their lowest common instruction set, which would
+ * leave the loops of the native kernels (the lanes kernel and, without BLAS, the matrix products) vectorized for SSE2
+ * only: when `KRONMULT_MULTI_ISA` is defined (on x86-64 with GCC or Clang), those kernels are also compiled for AVX2
+ * and AVX-512 and each call runs the widest variant supported by the CPU, as detected once at startup
+ *
+ * the `KRONMULT_ISA` environment variable (`generic`, `avx2` or `avx512`) caps the variant used, which lets you
+ * compare them on a single machine
+ *
+ * NOTE: the translation unit should be compiled for the lowest common instruction set (no `-march=native`), the
+ * variants being built on top of it
+ */
+
+#if defined(KRONMULT_MULTI_ISA) and defined(__x86_64__) and (defined(__GNUC__) or defined(__clang__))
+#define KRONMULT_DISPATCH
+#endif
+
+// instruction sets for which the native kernels are compiled, from the narrowest to the widest
+enum class kronmult_isa
+{
+    generic,
+    avx2,
+    avx512
+};
+
+/*
+ * returns the name of an instruction set
+ */
+inline char const *kronmult_isa_name(kronmult_isa const isa)
+{
+    switch (isa)
+    {
+        case kronmult_isa::avx512: return "avx512";
+        case kronmult_isa::avx2: return "avx2";
+        default: return "generic";
+    }
+}
+
+/*
+ * returns the widest instruction set supported by the CPU, among the ones the kernels are compiled for, capped by the
+ * `KRONMULT_ISA` environment variable
+ * always returns `generic` when the kernels are not multiversioned
+ */
+inline kronmult_isa kronmult_detect_isa()
+{
+    kronmult_isa isa = kronmult_isa::generic;
+#ifdef KRONMULT_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512vl") and
+        __builtin_cpu_supports("avx512bw") and __builtin_cpu_supports("avx512dq"))
+    {
+        isa = kronmult_isa::avx512;
+    }
+    else if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+    {
+        isa = kronmult_isa::avx2;
+    }
+    // caps the instruction set with the environment variable
+    char const *const requested = std::getenv("KRONMULT_ISA");
+    if (requested != nullptr)
+    {
+        if ((std::strcmp(requested, "generic") == 0) and (isa > kronmult_isa::generic)) isa = kronmult_isa::generic;
+        if ((std::strcmp(requested, "avx2") == 0) and (isa > kronmult_isa::avx2)) isa = kronmult_isa::avx2;
+    }
+#endif
+    return isa;
+}
+
+// instruction set used by the native kernels, picked once at startup
+inline kronmult_isa const kronmult_selected_isa = kronmult_detect_isa();
+
+/*
+ * returns the name of the instruction set whose variant of the native kernels runs on this machine
+ * ("generic" when the kernels are not multiversioned)
+ */
+inline char const *kronmult_dispatched_isa()
+{
+    return kronmult_isa_name(kronmult_selected_isa);
+}
+
+#ifdef KRONMULT_DISPATCH
+
+// the kernel, and everything it calls, is inlined in a function compiled for the given instruction set
+template<auto kernel, typename... Args>
+__attribute__((target("avx2,fma"), flatten)) void kronmult_run_avx2(Args... args)
+{
+    kernel(args...);
+}
+
+template<auto kernel, typename... Args>
+__attribute__((target("avx512f,avx512vl,avx512bw,avx512dq,avx2,fma"), flatten)) void
+kronmult_run_avx512(Args... args)
+{
+    kernel(args...);
+}
+
+#endif
+
+/*
+ * calls `kernel(args...)` compiled for the instruction set `isa`
+ *
+ * WARNING: the CPU must support `isa`, use `kronmult_dispatch` to get the variant picked at startup
+ */
+template<auto kernel, typename... Args>
+void kronmult_dispatch_to(kronmult_isa const isa, Args... args)
+{
+#ifdef KRONMULT_DISPATCH
+    switch (isa)
+    {
+        case kronmult_isa::avx512: kronmult_run_avx512<kernel>(args...); return;
+        case kronmult_isa::avx2: kronmult_run_avx2<kernel>(args...); return;
+        default: break;
+    }
+#else
+    (void)isa;
+#endif
+    kernel(args...);
+}
+
+/*
+ * calls `kernel(args...)` compiled for the instruction set picked at startup
+ */
+template<auto kernel, typename... Args>
+void kronmult_dispatch(Args... args)
+{
+    kronmult_dispatch_to<kernel>(kronmult_selected_isa, args...);
+}
@@ -0,0 +1,233 @@
+#pragma once
+#include "kronmult_utils.hpp"
+#include "linear_algebra.hpp"
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Explicit engine: for small kronecker products (`matrix_size`^`matrix_count` up to a few dozen elements) it can be
+ * faster to form kron(matrix_list) explicitly and do a dense matrix product, in particular when the same tuple of
+ * matrices is shared by many batch elements as all of them can then be processed with a single matrix-matrix product
+ *
+ * this is an opt-in entry point, `kronmult_batched` never uses it: the explicit product only does less work than the
+ * factored algorithm in dimension 1 and it pays off when its products are kept in a cache from one call to the next
+ */
+
+/*
+ * maximum number of batch elements processed by a single matrix-matrix product
+ * bounds the size of the workspaces and gives parallelism within large groups
+ */
+#ifndef KRONMULT_EXPLICIT_BLOCK_SIZE
+#define KRONMULT_EXPLICIT_BLOCK_SIZE 64
+#endif
+
+/*
+ * computes output = kron(matrix_list)
+ *
+ * `matrix_list` is an array containing pointers to `matrix_count` square matrices of size `matrix_size` by
+ * `matrix_size` and stride `matrix_stride` `output` is a square matrix of size `matrix_size`^`matrix_count` and
+ * stride its size
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void kronecker_product_explicit(int const matrix_count, int const matrix_size, T const *const matrix_list[],
+                                int const matrix_stride, T output[])
+{
+    // builds the product one matrix at a time, the first matrix being the outermost
+    output[0]     = 1.;
+    int size_kron = 1;
+    for (int m = 0; m < matrix_count; m++)
+    {
+        // kron(current, matrix) is written in place, going backward to not overwrite data that is still needed
+        T const *const matrix   = matrix_list[m];
+        int const size_kron_new = size_kron * matrix_size;
+        for (int col = size_kron_new - 1; col >= 0; col--)
+        {
+            for (int row = size_kron_new - 1; row >= 0; row--)
+            {
+                int const row_kron = row / matrix_size;
+                int const col_kron = col / matrix_size;
+                int const row_m    = row - row_kron * matrix_size;
+                int const col_m    = col - col_kron * matrix_size;
+                output[row + col * size_kron_new] =
+                    output[row_kron + col_kron * size_kron] * matrix[row_m + col_m * matrix_stride];
+            }
+        }
+        size_kron = size_kron_new;
+    }
+}
+
+/*
+ * groups the batch elements that share the same tuple of matrices
+ *
+ * `sorted_elements` contains the indices of the batch elements sorted by tuple (and by index within a tuple)
+ * the elements of group g are sorted_elements[group_starts[g]] to sorted_elements[group_starts[g+1]-1]
+ */
+struct kronmult_tuple_groups
+{
+    std::vector<int> sorted_elements;
+    std::vector<int> group_starts;
+
+    template<typename T>
+    kronmult_tuple_groups(int const matrix_count, T const *const matrix_list_batched[], int const nb_batch)
+        : sorted_elements(nb_batch)
+    {
+        // lexicographic order on the tuples of pointers
+        auto const tuple_less = [=](int const i, int const j) {
+            return std::lexicographical_compare(&matrix_list_batched[i * matrix_count],
+                                                &matrix_list_batched[(i + 1) * matrix_count],
+                                                &matrix_list_batched[j * matrix_count],
+                                                &matrix_list_batched[(j + 1) * matrix_count]);
+        };
+        std::iota(sorted_elements.begin(), sorted_elements.end(), 0);
+        std::stable_sort(sorted_elements.begin(), sorted_elements.end(), tuple_less);
+
+        // finds the boundaries of the groups
+        for (int k = 0; k < nb_batch; k++)
+        {
+            if ((k == 0) or tuple_less(sorted_elements[k - 1], sorted_elements[k])) group_starts.push_back(k);
+        }
+        group_starts.push_back(nb_batch);
+    }
+
+    int nb_groups() const { return static_cast<int>(group_starts.size()) - 1; }
+};
+
+/*
+ * stores the explicit kronecker products of tuples of matrices such that they can be reused from one call to the next
+ *
+ * WARNING: the tuples are identified by the addresses of their matrices, call `clear` if the content of the matrices
+ * changes
+ */
+template<typename T>
+class kronmult_explicit_cache
+{
+  public:
+    // drops all stored products
+    void clear() { products.clear(); }
+
+    // number of stored products
+    std::size_t size() const { return products.size(); }
+
+    // returns the storage for the product of the given tuple and whether it needs to be computed
+    // the storage stays valid until `clear` is called
+    std::pair<T *, bool> get(int const matrix_count, int const size_input, T const *const matrix_list[])
+    {
+        std::vector<T const *> key(matrix_list, matrix_list + matrix_count);
+        auto const inserted = products.emplace(std::move(key), std::vector<T>());
+        std::vector<T> &product = inserted.first->second;
+        if (inserted.second) product.resize(static_cast<std::size_t>(size_input) * size_input);
+        return {product.data(), inserted.second};
+    }
+
+  private:
+    std::map<std::vector<T const *>, std::vector<T>> products;
+};
+
+/*
+ * Computes output[K] += kron(matrix_list[K]) * input[K] for 0 <= k < batchCount using explicit kronecker products
+ * the batch elements sharing a tuple of matrices are processed together with matrix-matrix products
+ *
+ * takes the same arguments as `kronmult_batched` plus the precomputed `groups` and a `cache` of explicit products
+ * (which can be kept from one call to the next) `is_parallel` can be set to false to run small batches serially
+ * the inputs and workspaces are not modified
+ *
+ * WARNING: `groups` must have been built from the same `matrix_list_batched`
+ * throws an std::invalid_argument if they were not built for `nb_batch` elements
+ */
+template<typename T>
+void kronmult_batched_explicit(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                               int const matrix_stride, T *input_batched[], T *output_batched[], int const nb_batch,
+                               kronmult_tuple_groups const &groups, kronmult_explicit_cache<T> &cache,
+                               bool const is_parallel = true)
+{
+    if (groups.group_starts.back() != nb_batch)
+    {
+        throw std::invalid_argument("kronmult_batched_explicit: the groups do not cover the nb_batch elements");
+    }
+    int const size_input = pow_int(matrix_size, matrix_count);
+    int const nb_groups  = groups.nb_groups();
+
+    // gets the storage for all the products, computing the ones missing from the cache in parallel
+    std::vector<T *> products(nb_groups);
+    std::vector<int> missing_groups;
+    for (int g = 0; g < nb_groups; g++)
+    {
+        int const element  = groups.sorted_elements[groups.group_starts[g]];
+        auto const product = cache.get(matrix_count, size_input, &matrix_list_batched[element * matrix_count]);
+        products[g]        = product.first;
+        if (product.second) missing_groups.push_back(g);
+    }
+    int const nb_missing = static_cast<int>(missing_groups.size());
+    #pragma omp parallel for schedule(dynamic) if (is_parallel)
+    for (int m = 0; m < nb_missing; m++)
+    {
+        int const g       = missing_groups[m];
+        int const element = groups.sorted_elements[groups.group_starts[g]];
+        kronecker_product_explicit(matrix_count, matrix_size, &matrix_list_batched[element * matrix_count],
+                                   matrix_stride, products[g]);
+    }
+
+    // cuts the groups into blocks of at most KRONMULT_EXPLICIT_BLOCK_SIZE elements
+    std::vector<int> block_groups, block_starts;
+    for (int g = 0; g < nb_groups; g++)
+    {
+        for (int k = groups.group_starts[g]; k < groups.group_starts[g + 1]; k += KRONMULT_EXPLICIT_BLOCK_SIZE)
+        {
+            block_groups.push_back(g);
+            block_starts.push_back(k);
+        }
+    }
+    int const nb_blocks = static_cast<int>(block_starts.size());
+
+    // processes each block with a single matrix-matrix product
+    #pragma omp parallel if (is_parallel)
+    {
+        T *const inputs  = thread_workspace<T, 1>(size_input * KRONMULT_EXPLICIT_BLOCK_SIZE);
+        T *const outputs = thread_workspace<T, 2>(size_input * KRONMULT_EXPLICIT_BLOCK_SIZE);
+
+        #pragma omp for schedule(dynamic)
+        for (int b = 0; b < nb_blocks; b++)
+        {
+            int const g        = block_groups[b];
+            int const first    = block_starts[b];
+            int const nb_block = std::min(KRONMULT_EXPLICIT_BLOCK_SIZE, groups.group_starts[g + 1] - first);
+
+            // gathers the inputs as the columns of a matrix
+            for (int c = 0; c < nb_block; c++)
+            {
+                T const *const input = input_batched[groups.sorted_elements[first + c]];
+                std::copy(input, input + size_input, &inputs[c * size_input]);
+            }
+
+            // outputs = kron(matrix_list) * inputs
+            multiply(products[g], inputs, outputs, size_input, nb_block, size_input);
+
+            // scatters the columns to the outputs in a thread-safe way
+            for (int c = 0; c < nb_block; c++)
+            {
+                T *const output = output_batched[groups.sorted_elements[first + c]];
+                atomic_add_vector(output, &outputs[c * size_input], size_input);
+            }
+        }
+    }
+}
+
+/*
+ * Computes output[K] += kron(matrix_list[K]) * input[K] for 0 <= k < batchCount using explicit kronecker products
+ * takes the same arguments as `kronmult_batched`, the products are not kept from one call to the next
+ */
+template<typename T>
+void kronmult_batched_explicit(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                               int const matrix_stride, T *input_batched[], T *output_batched[],
+                               T * /*workspace_batched*/[], int const nb_batch)
+{
+    kronmult_tuple_groups const groups(matrix_count, matrix_list_batched, nb_batch);
+    kronmult_explicit_cache<T> cache;
+    kronmult_batched_explicit(matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched,
+                              output_batched, nb_batch, groups, cache);
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include "kronmult_operator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+ * Iterative solvers using a `kron_operator` as their matrix-vector product
+ *
+ * a whole solve runs within a single parallel region: the operator applications and the vector operations are
+ * shared between the threads of the same team, all vectors being traversed with the same static schedule such that
+ * each thread keeps touching the same part of them (the solver's buffers are first touched that way, which places
+ * their pages close to the threads using them on NUMA machines)
+ */
+
+/*
+ * outcome of an iterative solve
+ */
+template<typename T>
+struct krylov_result
+{
+    // number of operator applications done, not counting the ones computing the initial residual
+    int iterations;
+    // final residual norm, relative to the norm of the right-hand side
+    T residual_norm;
+    // true if the residual norm went under the requested tolerance
+    bool converged;
+};
+
+/*
+ * returns the dot product of `x` and `y`, two vectors of `size` elements
+ * it must be called by all the threads of the team and `sum` must be shared by the team
+ */
+template<typename T>
+T team_dot(T const x[], T const y[], size_t const size, T &sum)
+{
+    // waits for all threads to be done reading the previous value of `sum`
+    #pragma omp barrier
+    #pragma omp single
+    sum = 0.;
+
+    T partial_sum = 0.;
+    #pragma omp for schedule(static) nowait
+    for (size_t i = 0; i < size; i++) partial_sum += x[i] * y[i];
+    #pragma omp atomic
+    sum += partial_sum;
+
+    #pragma omp barrier
+    return sum;
+}
+
+/*
+ * solves K x = b with the conjugate gradient method
+ *
+ * `x` is used as the initial guess and contains the solution on exit, the solve stops once
+ * ||b - K x|| <= `tolerance`*||b|| or after `max_iterations` iterations
+ *
+ * WARNING: the operator is assumed to be symmetric positive definite
+ */
+template<typename T>
+krylov_result<T> kron_cg(kron_operator<T> const &op, T const b[], T x[], T const tolerance,
+                         int const max_iterations)
+{
+    size_t const size = op.vector_size();
+
+    // buffers, first touched within the parallel region
+    kronmult_aligned_array<T> const r_storage  = kronmult_make_aligned_array<T>(size);
+    kronmult_aligned_array<T> const p_storage  = kronmult_make_aligned_array<T>(size);
+    kronmult_aligned_array<T> const Kp_storage = kronmult_make_aligned_array<T>(size);
+    T *const r  = r_storage.get();
+    T *const p  = p_storage.get();
+    T *const Kp = Kp_storage.get();
+
+    // shared by the team
+    T sum;
+    krylov_result<T> result;
+
+    #pragma omp parallel if (op.is_parallel())
+    {
+        // r = b - K x and p = r
+        op.apply(x, Kp);
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < size; i++)
+        {
+            r[i] = b[i] - Kp[i];
+            p[i] = r[i];
+        }
+        T const bb        = team_dot(b, b, size, sum);
+        T const threshold = tolerance * tolerance * ((bb > 0.) ? bb : T{1});
+        T rr              = team_dot(r, r, size, sum);
+
+        int iteration = 0;
+        while ((iteration < max_iterations) and (rr > threshold))
+        {
+            op.apply(p, Kp);
+            T const alpha = rr / team_dot(p, Kp, size, sum);
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < size; i++)
+            {
+                x[i] += alpha * p[i];
+                r[i] -= alpha * Kp[i];
+            }
+            T const rr_new = team_dot(r, r, size, sum);
+            T const beta   = rr_new / rr;
+            rr             = rr_new;
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < size; i++) p[i] = r[i] + beta * p[i];
+            iteration++;
+        }
+
+        #pragma omp single
+        result = {iteration, std::sqrt(rr / ((bb > 0.) ? bb : T{1})), rr <= threshold};
+    }
+
+    return result;
+}
+
+/*
+ * solves K x = b with the restarted GMRES(`restart`) method
+ *
+ * `x` is used as the initial guess and contains the solution on exit, the solve stops once
+ * ||b - K x|| <= `tolerance`*||b|| or after `max_iterations` iterations (counted across restarts)
+ *
+ * the Krylov basis is orthogonalized with modified Gram-Schmidt, the small least-squares problem is solved with
+ * Givens rotations by a single thread
+ */
+template<typename T>
+krylov_result<T> kron_gmres(kron_operator<T> const &op, T const b[], T x[], T const tolerance,
+                            int const max_iterations, int const restart = 30)
+{
+    size_t const size = op.vector_size();
+
+    // Krylov basis, first touched within the parallel region
+    kronmult_aligned_array<T> const basis = kronmult_make_aligned_array<T>(static_cast<size_t>(restart + 1) * size);
+    auto const V = [&](int const j) { return &basis[static_cast<size_t>(j) * size]; };
+
+    // small dense problem, only touched by one thread at a time
+    // H is a (`restart`+1) by `restart` col-major Hessenberg matrix, g the rotated right-hand side
+    std::vector<T> H(static_cast<size_t>(restart + 1) * restart);
+    std::vector<T> cosines(restart), sines(restart), g(restart + 1), y(restart);
+
+    // shared by the team
+    T sum;
+    T residual_norm;
+    krylov_result<T> result;
+
+    #pragma omp parallel if (op.is_parallel())
+    {
+        T const bb        = team_dot(b, b, size, sum);
+        T const b_norm    = (bb > 0.) ? std::sqrt(bb) : T{1};
+        T const threshold = tolerance * b_norm;
+
+        int iteration  = 0;
+        bool converged = false;
+        while (not converged)
+        {
+            // V0 = b - K x
+            T *const v0 = V(0);
+            op.apply(x, v0);
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < size; i++) v0[i] = b[i] - v0[i];
+            T const beta = std::sqrt(team_dot(v0, v0, size, sum));
+            converged    = beta <= threshold;
+            if (converged or (iteration >= max_iterations))
+            {
+                #pragma omp single
+                residual_norm = beta;
+                break;
+            }
+
+            // V0 = V0 / beta
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < size; i++) v0[i] /= beta;
+            #pragma omp single
+            {
+                std::fill(g.begin(), g.end(), T{0});
+                g[0] = beta;
+            }
+
+            // Arnoldi iterations
+            int nb_vectors = 0;
+            for (int j = 0; (j < restart) and (iteration < max_iterations); j++)
+            {
+                T *const w = V(j + 1);
+                op.apply(V(j), w);
+                for (int i = 0; i <= j; i++)
+                {
+                    T const h         = team_dot(w, V(i), size, sum);
+                    T const *const vi = V(i);
+                    #pragma omp for schedule(static)
+                    for (size_t k = 0; k < size; k++) w[k] -= h * vi[k];
+                    #pragma omp single nowait
+                    H[i + j * (restart + 1)] = h;
+                }
+                T const h_next = std::sqrt(team_dot(w, w, size, sum));
+                if (h_next > 0.)
+                {
+                    #pragma omp for schedule(static)
+                    for (size_t k = 0; k < size; k++) w[k] /= h_next;
+                }
+
+                // updates the QR factorization of H with a new Givens rotation
+                #pragma omp single
+                {
+                    T *const column = &H[j * (restart + 1)];
+                    column[j + 1]   = h_next;
+                    for (int i = 0; i < j; i++)
+                    {
+                        T const temp  = cosines[i] * column[i] + sines[i] * column[i + 1];
+                        column[i + 1] = -sines[i] * column[i] + cosines[i] * column[i + 1];
+                        column[i]     = temp;
+                    }
+                    T const norm  = std::hypot(column[j], column[j + 1]);
+                    cosines[j]    = (norm > 0.) ? column[j] / norm : T{1};
+                    sines[j]      = (norm > 0.) ? column[j + 1] / norm : T{0};
+                    column[j]     = norm;
+                    column[j + 1] = 0.;
+                    g[j + 1]      = -sines[j] * g[j];
+                    g[j]          = cosines[j] * g[j];
+                    residual_norm = std::abs(g[j + 1]);
+                }
+
+                iteration++;
+                nb_vectors = j + 1;
+                if ((residual_norm <= threshold) or (h_next == 0.)) break;
+            }
+
+            // solves the triangular system H y = g and updates x += V y
+            #pragma omp single
+            for (int i = nb_vectors - 1; i >= 0; i--)
+            {
+                T value = g[i];
+                for (int k = i + 1; k < nb_vectors; k++) value -= H[i + k * (restart + 1)] * y[k];
+                y[i] = value / H[i + i * (restart + 1)];
+            }
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < size; i++)
+            {
+                T value = 0.;
+                for (int k = 0; k < nb_vectors; k++) value += V(k)[i] * y[k];
+                x[i] += value;
+            }
+        }
+
+        #pragma omp single
+        result = {iteration, residual_norm / b_norm, converged};
+    }
+
+    return result;
+}
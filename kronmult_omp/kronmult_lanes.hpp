@@ -0,0 +1,225 @@
+#pragma once
+#include "kronmult_dispatch.hpp"
+#include "kronmult_utils.hpp"
+#include <algorithm>
+#include <utility>
+
+/*
+ * Kernels for very small kronecker products (typically degrees 2 to 4 in dimensions 1 and 2)
+ *
+ * such products are too small for SIMD to be used within a single multiplication, instead we process several batch
+ * elements in lockstep, one per SIMD lane: their data is interleaved (struct-of-arrays layout) such that element
+ * `i` of lane `l` is stored at index `i*lanes + l`
+ */
+
+/*
+ * number of batch elements processed in lockstep
+ * one cache line (64 bytes) worth of elements, that is 8 doubles or 16 floats
+ */
+template<typename T>
+constexpr int kronmult_lanes_count = 64 / sizeof(T);
+
+/*
+ * maximum `matrix_size`^`matrix_count` for which `kronmult_batched` uses the lanes kernels
+ * can be overridden at compile time
+ */
+#ifndef KRONMULT_LANES_MAX_SIZE
+#define KRONMULT_LANES_MAX_SIZE 16
+#endif
+
+/*
+ * Computes Y = X^T * M^T for `lanes` interleaved problems
+ *
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * M is a `size_M` by `size_M` matrix of stride `size_M`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `nb_col_X`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order and interleaved
+ */
+template<typename T, int lanes>
+void multiply_transpose_lanes(T const X[], int const nb_col_X, T const M[], int const size_M, T Y[])
+{
+    for (int colX = 0; colX < nb_col_X; colX++)
+    {
+        for (int rowM = 0; rowM < size_M; rowM++)
+        {
+            T dotprod[lanes] = {};
+            for (int k = 0; k < size_M; k++)
+            {
+                T const *const x = &X[(k + colX * size_M) * lanes];
+                T const *const m = &M[(rowM + k * size_M) * lanes];
+                #pragma omp simd
+                for (int l = 0; l < lanes; l++) dotprod[l] += x[l] * m[l];
+            }
+            T *const y = &Y[(colX + rowM * nb_col_X) * lanes];
+            #pragma omp simd
+            for (int l = 0; l < lanes; l++) y[l] = dotprod[l];
+        }
+    }
+}
+
+/*
+ * Computes output[K] += kron(matrix_list[K]) * input[K] for first <= k < first+nb_elements
+ * with `nb_elements` <= `lanes`, processing the batch elements in lockstep
+ *
+ * `workspace` and `workspace2` are `size_input`*`lanes` elements vectors and `matrix_workspace` is a
+ * `matrix_size`*`matrix_size`*`lanes` elements vector, to be used as workspaces
+ * `is_thread_safe` should be false if other threads might be writing to the outputs
+ * if `transposed` is true, computes output[K] += kron(matrix_list[K])^T * input[K] instead
+ *
+ * the inputs are gathered into an interleaved layout (unused lanes are padded with zeros) and the results are
+ * scattered back to the outputs, the lanes sharing an output are summed together first such that each distinct
+ * output is written only once
+ */
+template<typename T, int lanes, bool transposed = false>
+void kronmult_lanes_kernel(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                           int const matrix_stride, T const *const input_batched[], T *const output_batched[],
+                           int const first, int const nb_elements, int const size_input, T workspace[],
+                           T workspace2[], T matrix_workspace[], bool const is_thread_safe)
+{
+    // gathers the inputs
+    T *input = workspace;
+    for (int j = 0; j < size_input; j++)
+    {
+        for (int l = 0; l < lanes; l++)
+        {
+            input[j * lanes + l] = (l < nb_elements) ? input_batched[first + l][j] : T{0};
+        }
+    }
+
+    // iterates on the matrices from last to first
+    int const nb_col_input = size_input / matrix_size;
+    T *output              = workspace2;
+    for (int d = matrix_count - 1; d >= 0; d--)
+    {
+        // gathers the matrices, transposing them on the fly if needed
+        for (int c = 0; c < matrix_size; c++)
+        {
+            for (int r = 0; r < matrix_size; r++)
+            {
+                for (int l = 0; l < lanes; l++)
+                {
+                    // unused lanes reuse the matrices of the last element
+                    int const element     = first + std::min(l, nb_elements - 1);
+                    T const *const matrix = matrix_list_batched[element * matrix_count + d];
+                    int const index = transposed ? (c + r * matrix_stride) : (r + c * matrix_stride);
+                    matrix_workspace[(r + c * matrix_size) * lanes + l] = matrix[index];
+                }
+            }
+        }
+        // the output becomes the input of the next iteration
+        multiply_transpose_lanes<T, lanes>(input, nb_col_input, matrix_workspace, matrix_size, output);
+        std::swap(input, output);
+    }
+
+    // sums the lanes that share an output into the first of them
+    bool is_merged[lanes] = {};
+    for (int l = 1; l < nb_elements; l++)
+    {
+        T const *const target = output_batched[first + l];
+        for (int f = 0; f < l; f++)
+        {
+            if ((not is_merged[f]) and (output_batched[first + f] == target))
+            {
+                for (int j = 0; j < size_input; j++) input[j * lanes + f] += input[j * lanes + l];
+                is_merged[l] = true;
+                break;
+            }
+        }
+    }
+
+    // scatters the results to the outputs
+    for (int l = 0; l < nb_elements; l++)
+    {
+        if (is_merged[l]) continue;
+        T *const target = output_batched[first + l];
+        if (is_thread_safe)
+        {
+            for (int j = 0; j < size_input; j++) target[j] += input[j * lanes + l];
+        }
+        else
+        {
+            for (int j = 0; j < size_input; j++)
+            {
+                #pragma omp atomic
+                target[j] += input[j * lanes + l];
+            }
+        }
+    }
+}
+
+/*
+ * `kronmult_lanes_kernel` compiled for the instruction set of the CPU (see `kronmult_dispatch.hpp`)
+ * as the lanes are processed in lockstep, wider SIMD instructions directly speed up the products
+ */
+template<typename T, int lanes, bool transposed = false>
+void kronmult_lanes(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                    int const matrix_stride, T const *const input_batched[], T *const output_batched[],
+                    int const first, int const nb_elements, int const size_input, T workspace[], T workspace2[],
+                    T matrix_workspace[], bool const is_thread_safe)
+{
+    kronmult_dispatch<kronmult_lanes_kernel<T, lanes, transposed>>(
+        matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched, output_batched, first,
+        nb_elements, size_input, workspace, workspace2, matrix_workspace, is_thread_safe);
+}
+
+/*
+ * serial version of `kronmult_batched` using the lanes kernel
+ * takes the same arguments as `kronmult_batched`, the inputs and workspaces are not modified
+ */
+template<typename T, bool transposed = false>
+void kronmult_batched_lanes_serial(int const matrix_count, int const matrix_size,
+                                   T const *const matrix_list_batched[], int const matrix_stride,
+                                   T *input_batched[], T *output_batched[], T * /*workspace_batched*/[],
+                                   int const nb_batch)
+{
+    constexpr int lanes  = kronmult_lanes_count<T>;
+    int const size_input = pow_int(matrix_size, matrix_count);
+
+    // interleaved workspaces
+    T *const workspace        = thread_workspace<T, 1>(size_input * lanes);
+    T *const workspace2       = thread_workspace<T, 2>(size_input * lanes);
+    T *const matrix_workspace = thread_workspace<T, 3>(matrix_size * matrix_size * lanes);
+    bool const is_thread_safe = not is_in_parallel_region();
+
+    for (int first = 0; first < nb_batch; first += lanes)
+    {
+        int const nb_elements = std::min(lanes, nb_batch - first);
+        kronmult_lanes<T, lanes, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched,
+                                 output_batched, first, nb_elements, size_input, workspace, workspace2,
+                                 matrix_workspace, is_thread_safe);
+    }
+}
+
+/*
+ * parallel version of `kronmult_batched` using the lanes kernel
+ * parallelizes over groups of batch elements, the inputs and workspaces are not modified
+ */
+template<typename T, bool transposed = false>
+void kronmult_batched_lanes_parallel(int const matrix_count, int const matrix_size,
+                                     T const *const matrix_list_batched[], int const matrix_stride,
+                                     T *input_batched[], T *output_batched[], T * /*workspace_batched*/[],
+                                     int const nb_batch)
+{
+    constexpr int lanes  = kronmult_lanes_count<T>;
+    int const size_input = pow_int(matrix_size, matrix_count);
+    int const nb_groups  = (nb_batch + lanes - 1) / lanes;
+
+    #pragma omp parallel
+    {
+        // interleaved workspaces, one per thread
+        T *const workspace        = thread_workspace<T, 1>(size_input * lanes);
+        T *const workspace2       = thread_workspace<T, 2>(size_input * lanes);
+        T *const matrix_workspace = thread_workspace<T, 3>(matrix_size * matrix_size * lanes);
+
+        #pragma omp for schedule(static)
+        for (int g = 0; g < nb_groups; g++)
+        {
+            int const first       = g * lanes;
+            int const nb_elements = std::min(lanes, nb_batch - first);
+            kronmult_lanes<T, lanes, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride,
+                                     input_batched, output_batched, first, nb_elements, size_input, workspace,
+                                     workspace2, matrix_workspace, false);
+        }
+    }
+}
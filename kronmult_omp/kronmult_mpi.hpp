@@ -0,0 +1,245 @@
+#pragma once
+#include "kronmult_sparse_grid.hpp"
+#include <algorithm>
+#include <mpi.h>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Distributed sparse grid batches
+ *
+ * the elements of a `kronmult_sparse_grid_batch` are partitioned between the ranks of a communicator by output
+ * ownership: each rank owns a contiguous range of elements, stores their input and output coefficients, and
+ * computes all the batch elements writing into them (no reduction of outputs is thus needed)
+ * the inputs owned by other ranks (the halo) are exchanged with non-blocking point-to-point communications that
+ * overlap with the batch elements that only read local inputs
+ */
+
+/*
+ * returns the MPI datatype corresponding to T
+ */
+template<typename T>
+MPI_Datatype kronmult_mpi_type()
+{
+    static_assert(std::is_same<T, double>::value or std::is_same<T, float>::value,
+                  "The function `kronmult_mpi_type` is only defined for float and double precision");
+    if constexpr (std::is_same<T, float>::value) return MPI_FLOAT;
+    else return MPI_DOUBLE;
+}
+
+/*
+ * splits the elements of a batch into `nb_ranks` contiguous ranges with about the same number of batch elements
+ * rank r owns the elements `partition[r]` <= e < `partition[r+1]`
+ */
+inline std::vector<int> kronmult_partition_by_outputs(kronmult_sparse_grid_batch const &batch, int const nb_ranks)
+{
+    std::vector<int> partition(nb_ranks + 1);
+    long long const nb_batch = batch.nb_batch();
+    for (int r = 0; r < nb_ranks; r++)
+    {
+        // first element whose batch elements start after r/nb_ranks of the total
+        long long const target = (nb_batch * r) / nb_ranks;
+        partition[r] = static_cast<int>(std::lower_bound(batch.connectivity_starts.begin(),
+                                                         batch.connectivity_starts.begin() + batch.nb_elements,
+                                                         target) -
+                                        batch.connectivity_starts.begin());
+    }
+    partition[nb_ranks] = batch.nb_elements;
+    return partition;
+}
+
+/*
+ * sparse grid batch distributed over the ranks of a communicator
+ *
+ * the constructor is collective, it takes the description of the whole batch (identical on all ranks) and only
+ * keeps the part needed by the calling rank along with the communication pattern of the halo exchange
+ */
+template<typename T>
+class kronmult_distributed
+{
+  public:
+    kronmult_distributed(MPI_Comm const comm, kronmult_sparse_grid_batch const &batch, int const matrix_size)
+        : comm(comm), matrix_count(batch.matrix_count), size_input(pow_int(matrix_size, batch.matrix_count)),
+          matrix_size(matrix_size)
+    {
+        int rank, nb_ranks;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &nb_ranks);
+        partition      = kronmult_partition_by_outputs(batch, nb_ranks);
+        first          = partition[rank];
+        nb_local       = partition[rank + 1] - first;
+        int const last = first + nb_local;
+
+        // lists the remote elements read by the local rows, sorted by index and thus grouped by owner
+        for (int k = batch.connectivity_starts[first]; k < batch.connectivity_starts[last]; k++)
+        {
+            int const j = batch.connectivity[k];
+            if ((j < first) or (j >= last)) halo_elements.push_back(j);
+        }
+        std::sort(halo_elements.begin(), halo_elements.end());
+        halo_elements.erase(std::unique(halo_elements.begin(), halo_elements.end()), halo_elements.end());
+        int const nb_halo = static_cast<int>(halo_elements.size());
+
+        // how many halo elements come from each rank
+        recv_counts.assign(nb_ranks, 0);
+        recv_displacements.assign(nb_ranks, 0);
+        for (int h = 0; h < nb_halo; h++)
+        {
+            int const owner = static_cast<int>(
+                std::upper_bound(partition.begin(), partition.end(), halo_elements[h]) - partition.begin() - 1);
+            recv_counts[owner]++;
+        }
+        for (int r = 1; r < nb_ranks; r++) recv_displacements[r] = recv_displacements[r - 1] + recv_counts[r - 1];
+
+        // lets the owners know which of their elements they will have to send
+        send_counts.assign(nb_ranks, 0);
+        send_displacements.assign(nb_ranks, 0);
+        MPI_Alltoall(recv_counts.data(), 1, MPI_INT, send_counts.data(), 1, MPI_INT, comm);
+        for (int r = 1; r < nb_ranks; r++) send_displacements[r] = send_displacements[r - 1] + send_counts[r - 1];
+        send_elements.resize(send_displacements[nb_ranks - 1] + send_counts[nb_ranks - 1]);
+        MPI_Alltoallv(halo_elements.data(), recv_counts.data(), recv_displacements.data(), MPI_INT,
+                      send_elements.data(), send_counts.data(), send_displacements.data(), MPI_INT, comm);
+        for (int &element : send_elements) element -= first;
+
+        // splits the local rows into the entries reading local inputs and the ones reading the halo
+        interior_starts.push_back(0);
+        boundary_starts.push_back(0);
+        for (int i = first; i < last; i++)
+        {
+            for (int k = batch.connectivity_starts[i]; k < batch.connectivity_starts[i + 1]; k++)
+            {
+                int const j = batch.connectivity[k];
+                if ((j >= first) and (j < last))
+                {
+                    interior_connectivity.push_back(j - first);
+                }
+                else
+                {
+                    int const h = static_cast<int>(std::lower_bound(halo_elements.begin(), halo_elements.end(), j) -
+                                                   halo_elements.begin());
+                    boundary_connectivity.push_back(h);
+                }
+            }
+            interior_starts.push_back(static_cast<int>(interior_connectivity.size()));
+            boundary_starts.push_back(static_cast<int>(boundary_connectivity.size()));
+        }
+
+        // hierarchical indices of the local and halo elements
+        auto const indices = batch.element_indices.begin();
+        local_indices.assign(indices + static_cast<size_t>(first) * matrix_count,
+                             indices + static_cast<size_t>(last) * matrix_count);
+        for (int const j : halo_elements)
+        {
+            halo_indices.insert(halo_indices.end(), indices + static_cast<size_t>(j) * matrix_count,
+                                indices + static_cast<size_t>(j + 1) * matrix_count);
+        }
+
+        // communication buffers
+        halo.resize(static_cast<size_t>(nb_halo) * size_input);
+        send_buffer.resize(send_elements.size() * size_input);
+
+        // messages are counted in elements rather than coefficients so that their size fits in an int
+        MPI_Type_contiguous(size_input, kronmult_mpi_type<T>(), &element_type);
+        MPI_Type_commit(&element_type);
+    }
+
+    // the datatype of an element is owned by the object, which can thus not be copied
+    kronmult_distributed(kronmult_distributed const &) = delete;
+    kronmult_distributed &operator=(kronmult_distributed const &) = delete;
+
+    ~kronmult_distributed()
+    {
+        int is_finalized;
+        MPI_Finalized(&is_finalized);
+        if (not is_finalized) MPI_Type_free(&element_type);
+    }
+
+    // index of the first element owned by this rank
+    int first_element() const { return first; }
+
+    // number of elements owned by this rank
+    int nb_local_elements() const { return nb_local; }
+
+    // number of remote elements read by this rank
+    int nb_halo_elements() const { return static_cast<int>(halo_elements.size()); }
+
+    // ranges of elements owned by each rank, see `kronmult_partition_by_outputs`
+    std::vector<int> const &element_partition() const { return partition; }
+
+    /*
+     * Computes output[i] += kron_d(operators_d[i,j]) * input[j] for all the output elements i owned by this rank
+     * this function is collective
+     *
+     * `input` and `output` contain the coefficients of the local elements (local element e, that is global element
+     * `first_element()`+e, starts at index e*`matrix_size`^`matrix_count`)
+     * see `kronmult_batched_sparse_grid` for the other arguments
+     */
+    void apply(T const *const operators[], int const operator_stride, T const input[], T output[])
+    {
+        int const nb_ranks = static_cast<int>(recv_counts.size());
+        int const tag      = 0;
+        std::vector<MPI_Request> recv_requests, send_requests;
+
+        // posts the receptions of the halo
+        for (int r = 0; r < nb_ranks; r++)
+        {
+            if (recv_counts[r] == 0) continue;
+            recv_requests.emplace_back();
+            MPI_Irecv(&halo[static_cast<size_t>(recv_displacements[r]) * size_input], recv_counts[r], element_type, r,
+                      tag, comm, &recv_requests.back());
+        }
+
+        // packs and sends the local inputs needed by other ranks
+        int const nb_send = static_cast<int>(send_elements.size());
+        #pragma omp parallel for schedule(static)
+        for (int s = 0; s < nb_send; s++)
+        {
+            std::copy_n(&input[static_cast<size_t>(send_elements[s]) * size_input], size_input,
+                        &send_buffer[static_cast<size_t>(s) * size_input]);
+        }
+        for (int r = 0; r < nb_ranks; r++)
+        {
+            if (send_counts[r] == 0) continue;
+            send_requests.emplace_back();
+            MPI_Isend(&send_buffer[static_cast<size_t>(send_displacements[r]) * size_input], send_counts[r],
+                      element_type, r, tag, comm, &send_requests.back());
+        }
+
+        // computes the contributions of local inputs while the halo is in flight
+        kronmult_sparse_grid_rows(matrix_count, matrix_size, nb_local, interior_starts.data(),
+                                  interior_connectivity.data(), local_indices.data(), local_indices.data(),
+                                  operators, operator_stride, input, output);
+
+        // computes the contributions of the halo
+        MPI_Waitall(static_cast<int>(recv_requests.size()), recv_requests.data(), MPI_STATUSES_IGNORE);
+        kronmult_sparse_grid_rows(matrix_count, matrix_size, nb_local, boundary_starts.data(),
+                                  boundary_connectivity.data(), local_indices.data(), halo_indices.data(),
+                                  operators, operator_stride, halo.data(), output);
+        MPI_Waitall(static_cast<int>(send_requests.size()), send_requests.data(), MPI_STATUSES_IGNORE);
+    }
+
+  private:
+    MPI_Comm comm;
+    // `size_input` contiguous coefficients, the unit of all messages
+    MPI_Datatype element_type;
+    int matrix_count;
+    int size_input;
+    int matrix_size;
+    int first;
+    int nb_local;
+    std::vector<int> partition;
+    // remote elements read by this rank, their hierarchical indices and their coefficients
+    std::vector<int> halo_elements;
+    std::vector<int> halo_indices;
+    std::vector<T> halo;
+    // number of elements received from (sent to) each rank and their position in `halo` (`send_elements`)
+    std::vector<int> recv_counts, recv_displacements;
+    std::vector<int> send_counts, send_displacements;
+    // local elements sent to other ranks and the buffer used to send their coefficients
+    std::vector<int> send_elements;
+    std::vector<T> send_buffer;
+    // local rows, split between the entries reading local inputs (interior) and the halo (boundary)
+    std::vector<int> local_indices;
+    std::vector<int> interior_starts, interior_connectivity;
+    std::vector<int> boundary_starts, boundary_connectivity;
+};
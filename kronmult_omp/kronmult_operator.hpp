@@ -0,0 +1,177 @@
+#pragma once
+#include "kronmult.hpp"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+/*
+ * Matrix-free linear operator y = K x defined by a batch of kronecker products
+ *
+ * batch element k computes y[output_offsets[k]:] += kron(matrix_list[k]) * x[input_offsets[k]:] where the
+ * slices are `matrix_size`^`matrix_count` elements long, x and y being two vectors of `vector_size` elements
+ *
+ * the description of the batch is built once (the elements are ordered by output such that consecutive
+ * elements can be accumulated before being written back) and the workspaces are kept from one application to the
+ * next, which makes it suitable as the matrix-vector product of an iterative solver (see `kronmult_krylov.hpp`)
+ *
+ * WARNINGS:
+ * - the matrices are referenced, not copied, they must stay alive as long as the operator
+ * - the matrices are assumed to be stored in col-major order
+ * - the sizes and offsets are assumed to be correct
+ */
+template<typename T>
+class kron_operator
+{
+  public:
+    /*
+     * `matrix_list_batched` is an array of `nb_batch`*`matrix_count` pointers to square matrices of size
+     * `matrix_size` by `matrix_size` and stride `matrix_stride` `input_offsets` and `output_offsets` are arrays
+     * of `nb_batch` offsets into the input and output vectors, which have `vector_size` elements
+     * (offsets and sizes are 64 bits as large vectors go past 2^31 elements)
+     */
+    kron_operator(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                  int const matrix_stride, size_t const input_offsets[], size_t const output_offsets[],
+                  int const nb_batch, size_t const vector_size)
+        : matrix_count(matrix_count), matrix_size(matrix_size), matrix_stride(matrix_stride),
+          nb_batch(nb_batch), vector_size_(vector_size), size_input(pow_int(matrix_size, matrix_count)),
+          matrix_list_batched(matrix_list_batched,
+                              matrix_list_batched + static_cast<size_t>(nb_batch) * matrix_count),
+          input_offsets(input_offsets, input_offsets + nb_batch),
+          output_offsets(output_offsets, output_offsets + nb_batch), order_by_output(nb_batch),
+          order_by_input(nb_batch)
+    {
+        // orders the elements such that the ones sharing an output (an input when transposed) are consecutive
+        std::iota(order_by_output.begin(), order_by_output.end(), 0);
+        std::stable_sort(order_by_output.begin(), order_by_output.end(),
+                         [&](int const i, int const j) { return output_offsets[i] < output_offsets[j]; });
+        std::iota(order_by_input.begin(), order_by_input.end(), 0);
+        std::stable_sort(order_by_input.begin(), order_by_input.end(),
+                         [&](int const i, int const j) { return input_offsets[i] < input_offsets[j]; });
+
+        is_parallel_ = kronmult_should_go_parallel(nb_batch, matrix_count, matrix_size);
+    }
+
+    // number of elements of the input and output vectors
+    size_t vector_size() const { return vector_size_; }
+
+    // true if the operator is large enough to be applied in parallel
+    bool is_parallel() const { return is_parallel_; }
+
+    /*
+     * computes y = K x
+     * when called from within a parallel region, it must be called by all the threads of the team (as a
+     * worksharing construct would) and the work is shared between them
+     */
+    void apply(T const x[], T y[]) const
+    {
+        apply_combination(T{1}, x, y);
+    }
+
+    /*
+     * computes y = sum_t coefficients[t] * vectors[t] + alpha * K x
+     * the linear combination of the `nb_terms` vectors is computed while y is initialized and the contributions of
+     * K are scaled as they are accumulated: there is no separate sweep over the vectors for the axpy updates
+     * `vectors` can contain y (to update it in place) but x must not alias y
+     * see `apply` for the conditions when called from within a parallel region
+     */
+    void apply_combination(T const alpha, T const x[], T y[], int const nb_terms = 0,
+                           T const coefficients[] = nullptr, T const *const vectors[] = nullptr) const
+    {
+        if (is_in_parallel_region())
+        {
+            apply_in_team<false>(alpha, x, y, nb_terms, coefficients, vectors);
+        }
+        else
+        {
+            #pragma omp parallel if (is_parallel_)
+            apply_in_team<false>(alpha, x, y, nb_terms, coefficients, vectors);
+        }
+    }
+
+    /*
+     * computes y = K^T x
+     * see `apply` for the conditions when called from within a parallel region
+     */
+    void apply_transposed(T const x[], T y[]) const
+    {
+        if (is_in_parallel_region())
+        {
+            apply_in_team<true>(T{1}, x, y, 0, nullptr, nullptr);
+        }
+        else
+        {
+            #pragma omp parallel if (is_parallel_)
+            apply_in_team<true>(T{1}, x, y, 0, nullptr, nullptr);
+        }
+    }
+
+  private:
+    /*
+     * shares the computation of y = sum_t coefficients[t] * vectors[t] + alpha * K x (or K^T) between the threads
+     * of the current team
+     * the vectors are traversed with a static schedule such that, when a solver uses the same schedule, each
+     * thread touches the same part of the vectors (which is good for NUMA locality)
+     */
+    template<bool transposed>
+    void apply_in_team(T const alpha, T const x[], T y[], int const nb_terms, T const coefficients[],
+                       T const *const vectors[]) const
+    {
+        // workspaces, allocated once per thread and reused from one application to the next
+        T *const transpose_workspace = thread_workspace<T, 0>(matrix_size * matrix_size);
+        T *const workspace           = thread_workspace<T, 1>(size_input);
+        T *const workspace2          = thread_workspace<T, 2>(size_input);
+        T *const accumulator         = thread_workspace<T, 3>(size_input);
+
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < vector_size_; i++)
+        {
+            T value = 0.;
+            for (int t = 0; t < nb_terms; t++) value += coefficients[t] * vectors[t][i];
+            y[i] = value;
+        }
+
+        // the transposed operator swaps the roles of the input and output offsets
+        std::vector<int> const &order       = transposed ? order_by_input : order_by_output;
+        std::vector<size_t> const &from_offset = transposed ? output_offsets : input_offsets;
+        std::vector<size_t> const &to_offset   = transposed ? input_offsets : output_offsets;
+
+        // static schedule such that each thread gets contiguous elements, likely to share outputs
+        T *current_output = nullptr;
+        #pragma omp for schedule(static) nowait
+        for (int o = 0; o < nb_batch; o++)
+        {
+            // writes the accumulated contributions back when the output changes
+            int const k     = order[o];
+            T *const output = &y[to_offset[k]];
+            if (output != current_output)
+            {
+                if (current_output != nullptr) atomic_add_vector(current_output, accumulator, size_input);
+                std::fill_n(accumulator, size_input, T{0});
+                current_output = output;
+            }
+
+            T const *const *matrix_list = &matrix_list_batched[static_cast<size_t>(k) * matrix_count];
+            T const *const result       = kronmult_contract<T, transposed>(
+                matrix_count, matrix_size, matrix_list, matrix_stride, &x[from_offset[k]], size_input,
+                workspace, workspace2, transpose_workspace);
+            for (int j = 0; j < size_input; j++) accumulator[j] += alpha * result[j];
+        }
+
+        // final write-back, y is complete once all threads are done
+        if (current_output != nullptr) atomic_add_vector(current_output, accumulator, size_input);
+        #pragma omp barrier
+    }
+
+    int matrix_count;
+    int matrix_size;
+    int matrix_stride;
+    int nb_batch;
+    size_t vector_size_;
+    int size_input;
+    bool is_parallel_;
+    std::vector<T const *> matrix_list_batched;
+    std::vector<size_t> input_offsets;
+    std::vector<size_t> output_offsets;
+    std::vector<int> order_by_output;
+    std::vector<int> order_by_input;
+};
@@ -0,0 +1,165 @@
+#pragma once
+#include "kronmult.hpp"
+#include <vector>
+
+/*
+ * Batches built directly from a sparse grid description
+ *
+ * in a sparse grid code, batch element (i,j) applies kron_d(A_d[i,j]) to the coefficients of element j and adds
+ * the result to the coefficients of element i where A_d[i,j] is the `degree` by `degree` block of the operator of
+ * dimension d found at the row of i and the column of j (both given by the hierarchical index of the element in
+ * that dimension)
+ *
+ * rather than building pointer arrays, we store the element connectivity (in CSR format, grouped by output
+ * element) and the hierarchical index of each element in each dimension: the matrices are located with a bit of
+ * arithmetic, the inputs and outputs are slices of two vectors and, as each output is computed by a single thread,
+ * no atomic addition is needed
+ */
+
+/*
+ * returns the position, within a dimension, of the cell `cell` of level `level` in hierarchical order
+ * level 0 has a single cell and level l>0 has 2^(l-1) cells
+ */
+inline int kronmult_hierarchical_index(int const level, int const cell)
+{
+    return (level == 0) ? 0 : (1 << (level - 1)) + cell;
+}
+
+/*
+ * compact description of a sparse grid batch
+ * the batch elements are the entries (i,j) of the connectivity, batch element k having output element i with
+ * `connectivity_starts[i]` <= k < `connectivity_starts[i+1]` and input element `connectivity[k]`
+ */
+struct kronmult_sparse_grid_batch
+{
+    int matrix_count;
+    int nb_elements;
+    // connectivity, in CSR format
+    std::vector<int> connectivity_starts;
+    std::vector<int> connectivity;
+    // hierarchical index of element e in dimension d at `e`*`matrix_count`+`d`
+    std::vector<int> element_indices;
+
+    // number of batch elements
+    int nb_batch() const { return connectivity_starts[nb_elements]; }
+};
+
+/*
+ * builds a `kronmult_sparse_grid_batch` from a sparse grid description
+ *
+ * `element_levels` and `element_cells` are arrays of `nb_elements`*`matrix_count` integers, the level and cell of
+ * element e in dimension d being stored at `e`*`matrix_count`+`d`
+ * `connectivity_starts` (`nb_elements`+1 integers) and `connectivity` describe, in CSR format, the input elements
+ * connected to each output element
+ *
+ * the description is built in parallel
+ */
+inline kronmult_sparse_grid_batch
+kronmult_build_sparse_grid_batch(int const matrix_count, int const nb_elements, int const element_levels[],
+                                 int const element_cells[], int const connectivity_starts[],
+                                 int const connectivity[])
+{
+    kronmult_sparse_grid_batch batch;
+    batch.matrix_count = matrix_count;
+    batch.nb_elements  = nb_elements;
+    batch.connectivity_starts.assign(connectivity_starts, connectivity_starts + nb_elements + 1);
+    int const nb_batch = connectivity_starts[nb_elements];
+    batch.connectivity.resize(nb_batch);
+    batch.element_indices.resize(static_cast<size_t>(nb_elements) * matrix_count);
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static) nowait
+        for (int k = 0; k < nb_batch; k++) batch.connectivity[k] = connectivity[k];
+
+        #pragma omp for schedule(static)
+        for (int e = 0; e < nb_elements; e++)
+        {
+            for (int d = 0; d < matrix_count; d++)
+            {
+                int const i              = e * matrix_count + d;
+                batch.element_indices[i] = kronmult_hierarchical_index(element_levels[i], element_cells[i]);
+            }
+        }
+    }
+
+    return batch;
+}
+
+/*
+ * Computes output[i] += kron_d(operators_d[i,j]) * input[j] for the entries (i,j) of a connectivity
+ *
+ * lower level version of `kronmult_batched_sparse_grid` in which input and output elements are numbered
+ * independently: the rows 0 <= i < `nb_rows` of the `connectivity` (in CSR format) are output elements whose
+ * hierarchical indices are stored in `output_indices` while its columns are input elements whose hierarchical
+ * indices are stored in `input_indices` (both `matrix_count` indices per element)
+ * see `kronmult_batched_sparse_grid` for the other arguments
+ */
+template<typename T>
+void kronmult_sparse_grid_rows(int const matrix_count, int const matrix_size, int const nb_rows,
+                               int const connectivity_starts[], int const connectivity[],
+                               int const output_indices[], int const input_indices[], T const *const operators[],
+                               int const operator_stride, T const input[], T output[])
+{
+    int const size_input = pow_int(matrix_size, matrix_count);
+
+    long long const nb_batch = connectivity_starts[nb_rows] - connectivity_starts[0];
+    bool const is_parallel   = kronmult_should_go_parallel(nb_batch, matrix_count, matrix_size);
+
+    #pragma omp parallel if (is_parallel)
+    {
+        // workspaces, allocated once per thread and reused from one call to the next
+        T *const transpose_workspace = thread_workspace<T, 0>(matrix_size * matrix_size);
+        T *const workspace           = thread_workspace<T, 1>(size_input);
+        T *const workspace2          = thread_workspace<T, 2>(size_input);
+        T const **const matrix_list  = thread_workspace<T const *, 3>(matrix_count);
+
+        // the number of inputs varies from one output to the other
+        #pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < nb_rows; i++)
+        {
+            T *const output_i        = &output[static_cast<size_t>(i) * size_input];
+            int const *const index_i = &output_indices[static_cast<size_t>(i) * matrix_count];
+            for (int k = connectivity_starts[i]; k < connectivity_starts[i + 1]; k++)
+            {
+                // locates the blocks of the operators
+                int const j              = connectivity[k];
+                int const *const index_j = &input_indices[static_cast<size_t>(j) * matrix_count];
+                for (int d = 0; d < matrix_count; d++)
+                {
+                    size_t const row    = static_cast<size_t>(index_i[d]) * matrix_size;
+                    size_t const column = static_cast<size_t>(index_j[d]) * matrix_size;
+                    matrix_list[d]      = &operators[d][row + column * operator_stride];
+                }
+
+                T const *const result =
+                    kronmult_contract(matrix_count, matrix_size, matrix_list, operator_stride,
+                                      &input[static_cast<size_t>(j) * size_input], size_input, workspace,
+                                      workspace2, transpose_workspace);
+                for (int n = 0; n < size_input; n++) output_i[n] += result[n];
+            }
+        }
+    }
+}
+
+/*
+ * Computes output[i] += kron_d(operators_d[i,j]) * input[j] for all the entries (i,j) of the batch's connectivity
+ *
+ * `operators` is an array of `matrix_count` pointers to the col-major operator of each dimension, of stride
+ * `operator_stride`, block [i,j] of operator d being the `matrix_size` by `matrix_size` matrix starting at row
+ * `matrix_size`*index_d(i) and column `matrix_size`*index_d(j)
+ * `input` and `output` are vectors of `nb_elements`*`matrix_size`^`matrix_count` elements, the coefficients of
+ * element e starting at index e*`matrix_size`^`matrix_count`
+ *
+ * NOTE: the input is not modified, no workspace is required and no atomic addition is used as each output
+ * element is computed by a single thread
+ */
+template<typename T>
+void kronmult_batched_sparse_grid(kronmult_sparse_grid_batch const &batch, int const matrix_size,
+                                  T const *const operators[], int const operator_stride, T const input[],
+                                  T output[])
+{
+    kronmult_sparse_grid_rows(batch.matrix_count, matrix_size, batch.nb_elements, batch.connectivity_starts.data(),
+                              batch.connectivity.data(), batch.element_indices.data(),
+                              batch.element_indices.data(), operators, operator_stride, input, output);
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "kronmult_async.hpp"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * describes a chunk of a streamed batch
+ * it is filled by the user-provided generator with the pointers of the batch elements it contains
+ */
+template<typename T>
+struct kronmult_chunk
+{
+    // index of the first batch element of the chunk and number of elements in the chunk
+    int first;
+    int nb_batch;
+    // 0 or 1, the generator can use it to double buffer its own storage
+    // (the inputs of a slot are in use until the chunk with the same slot is generated again)
+    int slot;
+    // arrays describing the chunk, as expected by `kronmult_batched`, to be filled by the generator
+    // their size is already set to `nb_batch`*`matrix_count` and `nb_batch` respectively
+    std::vector<T const *> matrix_list_batched;
+    std::vector<T *> input_batched;
+    std::vector<T *> output_batched;
+};
+
+/*
+ * function that fills the pointers of a chunk
+ * the chunk's `first`, `nb_batch` and `slot` fields are set by the caller
+ */
+template<typename T>
+using kronmult_chunk_generator = std::function<void(kronmult_chunk<T> &chunk)>;
+
+/*
+ * Computes output[K] += kron(matrix_list[K]) * input[K] for 0 <= k < batchCount
+ * processing the batch in chunks of at most `chunk_size` elements produced on demand by `generator`
+ *
+ * this lets you run batches that are too large to be allocated at once: only two chunks are alive at any
+ * given time, the next chunk being generated (on the calling thread) while the current one is computed (by the
+ * asynchronous worker, see `kronmult_batched_async`) the workspaces are allocated once, for a single chunk
+ * throws an std::invalid_argument if `chunk_size` is not positive
+ *
+ * WARNINGS:
+ * - the inputs of a chunk will be used as temporary workspaces and thus modified
+ * - the inputs of a chunk must stay valid until the next chunk with the same slot is generated
+ * - the generator is called from the calling thread, it can use OpenMP if it is cheap enough
+ * - if the generator throws, the computation of the current chunk is waited for before the exception is propagated
+ * - see `kronmult_batched` for the other assumptions on the inputs
+ */
+template<typename T>
+void kronmult_batched_streaming(int const matrix_count, int const matrix_size, int const matrix_stride,
+                                int const nb_batch, int const chunk_size,
+                                kronmult_chunk_generator<T> const &generator)
+{
+    if (chunk_size <= 0) throw std::invalid_argument("kronmult_batched_streaming: chunk_size must be positive");
+    if (nb_batch <= 0) return;
+
+    // numbers of elements in the input vector
+    int const size_input = pow_int(matrix_size, matrix_count);
+
+    // workspaces for a single chunk, as only one chunk is computed at a time
+    int const max_chunk_size = std::min(chunk_size, nb_batch);
+    kronmult_aligned_array<T> const workspace_storage =
+        kronmult_make_aligned_array<T>(static_cast<size_t>(max_chunk_size) * size_input);
+    std::vector<T *> workspace_batched(max_chunk_size);
+    for (int i = 0; i < max_chunk_size; i++)
+    {
+        workspace_batched[i] = &workspace_storage[static_cast<size_t>(i) * size_input];
+    }
+
+    // fills the given chunk with the elements starting at `first`
+    auto generate = [&](kronmult_chunk<T> &chunk, int const first, int const slot) {
+        chunk.first    = first;
+        chunk.nb_batch = std::min(chunk_size, nb_batch - first);
+        chunk.slot     = slot;
+        chunk.matrix_list_batched.resize(static_cast<size_t>(chunk.nb_batch) * matrix_count);
+        chunk.input_batched.resize(chunk.nb_batch);
+        chunk.output_batched.resize(chunk.nb_batch);
+        generator(chunk);
+    };
+
+    // double buffering: generates chunk c+1 while chunk c is being computed
+    kronmult_chunk<T> chunks[2];
+    generate(chunks[0], 0, 0);
+    for (int first = 0, slot = 0; first < nb_batch; first += chunk_size, slot = 1 - slot)
+    {
+        kronmult_chunk<T> &chunk = chunks[slot];
+        kronmult_handle handle =
+            kronmult_batched_async(matrix_count, matrix_size, chunk.matrix_list_batched.data(), matrix_stride,
+                                   chunk.input_batched.data(), chunk.output_batched.data(),
+                                   workspace_batched.data(), chunk.nb_batch);
+        int const next_first = first + chunk_size;
+        try
+        {
+            if (next_first < nb_batch) generate(chunks[1 - slot], next_first, 1 - slot);
+        }
+        catch (...)
+        {
+            // the worker uses the chunk and the workspaces, they must outlive it
+            handle.wait();
+            throw;
+        }
+        handle.get();
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "kronmult.hpp"
+#include <algorithm>
+
+/*
+ * Kronecker sums
+ *
+ * an operator of the form kron(A_0, I, ..., I) + kron(I, A_1, ..., I) + ... + kron(I, ..., I, A_{d-1}) can be
+ * expressed as `matrix_count` terms full of identities but each term would then cost as much as a full product
+ * here each matrix is only applied along its own mode of the input tensor, which costs a single contraction per
+ * matrix: a Kronecker sum costs as much as a single Kronecker product (rather than `matrix_count` of them)
+ */
+
+/*
+ * Computes accumulator += kronsum(matrix_list) * input
+ *
+ * `matrix_list` is an array containing pointers to `matrix_count` square matrices of size `matrix_size` by
+ * `matrix_size` and stride `matrix_stride`, the first one acting on the outermost (slowest) mode of `input`
+ * a null pointer in `matrix_list` stands for a zero matrix, its mode being skipped
+ * `input` and `accumulator` are `size_input` (`matrix_size`^`matrix_count`) elements vectors
+ *
+ * WARNINGS:
+ * - the matrices are assumed to be stored in col-major order
+ * - the sizes are assumed to be correct
+ */
+template<typename T>
+void kronmult_sum_accumulate(int const matrix_count, int const matrix_size, T const *const matrix_list[],
+                             int const matrix_stride, T const input[], int const size_input, T accumulator[])
+{
+    // the input is seen as `nb_outer` blocks of `nb_inner` by `matrix_size` col-major matrices
+    // the columns of the blocks being the mode of the current matrix
+    int nb_outer = 1;
+    int nb_inner = size_input / matrix_size;
+    for (int m = 0; m < matrix_count; m++)
+    {
+        T const *const matrix = matrix_list[m];
+        if (matrix != nullptr)
+        {
+            if (nb_inner == 1)
+            {
+                // innermost mode, the blocks form a single `matrix_size` by `nb_outer` matrix
+                multiply_add<T>(matrix, matrix_size, matrix_stride, input, nb_outer, accumulator);
+            }
+            else
+            {
+                int const size_block = nb_inner * matrix_size;
+                for (int b = 0; b < nb_outer; b++)
+                {
+                    size_t const offset = static_cast<size_t>(b) * size_block;
+                    multiply_add_transpose<T>(&input[offset], nb_inner, matrix, matrix_size, matrix_stride,
+                                              &accumulator[offset]);
+                }
+            }
+        }
+        nb_outer *= matrix_size;
+        nb_inner /= matrix_size;
+    }
+}
+
+/*
+ * Computes output[K] += kronsum(matrix_list[K]) * input[K] for 0 <= k < batchCount
+ * where kronsum(A_0, ..., A_{d-1}) = kron(A_0, I, ..., I) + ... + kron(I, ..., I, A_{d-1})
+ * assuming that some of the output pointers will be equal requiring a thread-safe addition
+ *
+ * takes the same arguments as `kronmult_batched` except for the workspaces
+ * a null pointer in `matrix_list_batched` stands for a zero matrix (a Kronecker sum that skips that mode)
+ *
+ * all the modes of a batch element (and of consecutive batch elements sharing the same output) are accumulated in a
+ * per-thread buffer which is then added to the output with a single write-back
+ *
+ * NOTE: unlike `kronmult_batched`, the inputs are not modified and no workspace is required (they are
+ * allocated once per thread and kept from one call to the next)
+ *
+ * WARNINGS:
+ * - the matrices are assumed to be stored in col-major order
+ * - the sizes are assumed to be correct
+ * - the fewer changes of output pointer between consecutive batch elements, the fewer write-backs
+ */
+template<typename T>
+void kronmult_batched_sum(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                          int const matrix_stride, T const *const input_batched[], T *const output_batched[],
+                          int const nb_batch)
+{
+    // numbers of elements in the input vector
+    int const size_input = pow_int(matrix_size, matrix_count);
+
+    bool const is_parallel = kronmult_should_go_parallel(nb_batch, matrix_count, matrix_size);
+
+    // are other threads potentially writing to the outputs
+    bool const is_thread_safe = (not is_parallel) and (not is_in_parallel_region());
+
+    #pragma omp parallel if (is_parallel)
+    {
+        // sum of all the contributions to `current_output` computed so far by this thread
+        // allocated once per thread and reused from one call to the next
+        T *const accumulator = thread_workspace<T, 3>(size_input);
+        T *current_output    = nullptr;
+
+        // adds the accumulated contributions to `current_output`
+        auto write_back = [&]() {
+            if (current_output == nullptr) return;
+            if (is_thread_safe)
+            {
+                for (int j = 0; j < size_input; j++) current_output[j] += accumulator[j];
+            }
+            else
+            {
+                atomic_add_vector(current_output, accumulator, size_input);
+            }
+        };
+
+        // static schedule such that each thread gets contiguous batch elements, likely to share outputs
+        #pragma omp for schedule(static)
+        for (int i = 0; i < nb_batch; i++)
+        {
+            // writes the accumulated contributions back when the output changes
+            T *const output = output_batched[i];
+            if (output != current_output)
+            {
+                write_back();
+                std::fill_n(accumulator, size_input, T{0});
+                current_output = output;
+            }
+
+            T const *const *matrix_list = &matrix_list_batched[static_cast<size_t>(i) * matrix_count];
+            kronmult_sum_accumulate(matrix_count, matrix_size, matrix_list, matrix_stride, input_batched[i],
+                                    size_input, accumulator);
+        }
+
+        // final write-back
+        write_back();
+    }
+}
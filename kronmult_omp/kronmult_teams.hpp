@@ -0,0 +1,152 @@
+#pragma once
+#include "kronmult_utils.hpp"
+#include "linear_algebra.hpp"
+#include <algorithm>
+#include <utility>
+
+/*
+ * Cooperative execution: one team of threads per batch element
+ *
+ * `kronmult_batched_parallel` gives whole batch elements to each thread: with large products, every thread streams
+ * its own input and workspace (2MB each at degree 8 in dimension 6) and they compete for the last level cache
+ * here, as in the GPU version (one block per batch element), the threads are grouped in small teams that process one
+ * batch element at a time: each matrix product is split by columns of the input between the threads of the team
+ * and the final addition to the output by slices, the working set of a team is thus that of a single batch element
+ * and a team adds to an output in disjoint slices (the atomics only compete with other teams)
+ *
+ * the teams are nested parallel regions, spread over the places of the machine while the threads of a team are kept
+ * close to one another: with `OMP_PLACES=cores`, a team of 2 to 8 threads lands on cores that share an L2 or an L3
+ * slice (CCX), pick `team_size` accordingly
+ */
+
+// number of threads per team, used by `kronmult_batched` for large products when larger than 1
+// (the default, 1, keeps `kronmult_batched` on one thread per batch element)
+#ifndef KRONMULT_TEAM_SIZE
+#define KRONMULT_TEAM_SIZE 1
+#endif
+
+// size of the input under which `kronmult_batched` does not use teams, the products being small enough to stay in
+// the private caches of a thread and too small to be split between threads
+#ifndef KRONMULT_TEAM_MIN_SIZE
+#define KRONMULT_TEAM_MIN_SIZE 32768
+#endif
+
+/*
+ * Computes output[K] += kron(matrix_list[K]) * input[K] for 0 <= k < batchCount with teams of `team_size` threads
+ * assuming that some of the output pointers will be equal requiring a thread-safe addition
+ *
+ * takes the same arguments as `kronmult_batched`
+ * uses omp_get_max_threads()/`team_size` teams, each one processing contiguous batch elements
+ * when called from within a parallel region, it runs on the calling thread
+ *
+ * NOTE: the teams require nested parallelism, the maximum number of active levels is raised to 2 during the call
+ * (if it was lower) and then restored
+ *
+ * WARNINGS:
+ * - `input_batched` and `workspace_batched` will be used as temporary workspaces and thus modified
+ * - the matrices are assumed to be stored in col-major order
+ * - the sizes are assumed to be correct
+ */
+template<typename T, bool transposed = false>
+void kronmult_batched_teams(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                            int const matrix_stride, T *input_batched[], T *output_batched[],
+                            T *workspace_batched[], int const nb_batch, int const team_size = KRONMULT_TEAM_SIZE)
+{
+    // numbers of elements in the input vector
+    int const size_input = pow_int(matrix_size, matrix_count);
+    // how many column should `input` have for the multiplications to be legal
+    int const nb_col_input = size_input / matrix_size;
+
+    // splits the threads into teams
+    bool const is_nested = is_in_parallel_region();
+    #ifdef _OPENMP
+    int const nb_threads        = is_nested ? 1 : omp_get_max_threads();
+    int const max_active_levels = omp_get_max_active_levels();
+    if (max_active_levels < 2) omp_set_max_active_levels(2);
+    #else
+    int const nb_threads = 1;
+    #endif
+    int const threads_per_team = std::max(1, std::min(team_size, nb_threads));
+    int const nb_teams         = std::max(1, nb_threads / threads_per_team);
+
+    // are other teams (or threads) potentially writing to the outputs
+    bool const is_thread_safe = (nb_teams == 1) and (not is_nested);
+
+    #pragma omp parallel num_threads(nb_teams) proc_bind(spread) if (nb_teams > 1)
+    {
+        #ifdef _OPENMP
+        int const team = omp_get_thread_num();
+        #else
+        int const team = 0;
+        #endif
+        // contiguous batch elements, likely to share outputs
+        int const first = static_cast<int>((static_cast<long long>(nb_batch) * team) / nb_teams);
+        int const last  = static_cast<int>((static_cast<long long>(nb_batch) * (team + 1)) / nb_teams);
+
+        #pragma omp parallel num_threads(threads_per_team) proc_bind(close) if (threads_per_team > 1)
+        {
+            #ifdef _OPENMP
+            int const rank            = omp_get_thread_num();
+            int const nb_team_threads = omp_get_num_threads();
+            #else
+            int const rank            = 0;
+            int const nb_team_threads = 1;
+            #endif
+            // columns of the input, and slice of the output, handled by this thread
+            int const col_begin = (nb_col_input * rank) / nb_team_threads;
+            int const col_end   = (nb_col_input * (rank + 1)) / nb_team_threads;
+            int const begin     = col_begin * matrix_size;
+            int const end       = col_end * matrix_size;
+
+            // workspace that will be used to store matrix transpositions
+            T *const transpose_workspace = thread_workspace<T>(matrix_size * matrix_size);
+
+            for (int i = first; i < last; i++)
+            {
+                T const *const *matrix_list = &matrix_list_batched[static_cast<size_t>(i) * matrix_count];
+                T *source                   = input_batched[i];
+                T *destination              = workspace_batched[i];
+
+                // iterates on the matrices from last to first, each thread producing the rows of the result
+                // that correspond to its columns of the input
+                for (int m = matrix_count - 1; m >= 0; m--)
+                {
+                    T const *const matrix = matrix_list[m];
+                    int const nb_col      = col_end - col_begin;
+                    if (nb_col > 0)
+                    {
+                        if constexpr (transposed)
+                        {
+                            multiply_transpose_X_strided<T>(&source[begin], nb_col, matrix, matrix_size,
+                                                            matrix_stride, &destination[col_begin], nb_col_input);
+                        }
+                        else
+                        {
+                            multiply_transpose_strided<T>(&source[begin], nb_col, matrix, matrix_size,
+                                                          matrix_stride, &destination[col_begin], nb_col_input,
+                                                          transpose_workspace);
+                        }
+                    }
+                    // the next product reads columns written by the other threads of the team
+                    #pragma omp barrier
+                    std::swap(source, destination);
+                }
+
+                // adds the result to the output, each thread taking a slice
+                T *const output = output_batched[i];
+                if (is_thread_safe)
+                {
+                    for (int j = begin; j < end; j++) output[j] += source[j];
+                }
+                else
+                {
+                    atomic_add_vector(&output[begin], &source[begin], end - begin);
+                }
+            }
+        }
+    }
+
+    #ifdef _OPENMP
+    if (max_active_levels < 2) omp_set_max_active_levels(max_active_levels);
+    #endif
+}
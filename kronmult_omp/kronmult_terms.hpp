@@ -0,0 +1,94 @@
+#pragma once
+#include "kronmult.hpp"
+#include <algorithm>
+
+/*
+ * Computes output[K] += sum_t kron(matrix_list_t[K]) * input[K] for 0 <= k < batchCount and 0 <= t < term_count
+ * assuming that some of the output pointers will be equal requiring a thread-safe addition
+ *
+ * This is equivalent to calling `kronmult_batched` once per term but it is done within a single parallel region:
+ * all the terms of a batch element (and of consecutive batch elements sharing the same output) are accumulated
+ * in a per-thread buffer which is then added to the output with a single write-back (thread-safe when running in
+ * parallel, small batches being run serially).
+ *
+ * `matrix_list_batched_terms` is an array of `term_count` pointers to arrays of `nb_batch`*`matrix_count`
+ * pointers to square matrices of size `matrix_size` by `matrix_size` and stride `matrix_stride` (the
+ * `matrix_list_batched` of each term) `input_batched` is an array of `nb_batch` pointers to array of size
+ * `matrix_size`^`matrix_count` `output_batched` is an array of `nb_batch` pointers to array of size
+ * `matrix_size`^`matrix_count`, to which the outputs will be added
+ *
+ * NOTE: unlike `kronmult_batched`, the inputs are not modified and no workspace is required (they are
+ * allocated once per thread and kept from one call to the next)
+ *
+ * WARNINGS:
+ * - the matrices are assumed to be stored in col-major order
+ * - the sizes are assumed to be correct
+ * - the fewer changes of output pointer between consecutive batch elements, the fewer write-backs
+ */
+template<typename T>
+void kronmult_batched_terms(int const matrix_count, int const matrix_size, int const term_count,
+                            T const *const *const matrix_list_batched_terms[], int const matrix_stride,
+                            T const *const input_batched[], T *const output_batched[], int const nb_batch)
+{
+    // numbers of elements in the input vector
+    int const size_input = pow_int(matrix_size, matrix_count);
+
+    // each term costs as much as a batch element of `kronmult_batched`
+    bool const is_parallel = kronmult_should_go_parallel(static_cast<long long>(nb_batch) * term_count, matrix_count,
+                                                         matrix_size);
+
+    // are other threads potentially writing to the outputs
+    bool const is_thread_safe = (not is_parallel) and (not is_in_parallel_region());
+
+    // paralelize over batch elements
+    #pragma omp parallel if (is_parallel)
+    {
+        // workspaces, allocated once per thread and reused from one call to the next
+        T *const transpose_workspace = thread_workspace<T, 0>(matrix_size * matrix_size);
+        T *const workspace           = thread_workspace<T, 1>(size_input);
+        T *const workspace2          = thread_workspace<T, 2>(size_input);
+        // sum of all the contributions to `current_output` computed so far by this thread
+        T *const accumulator = thread_workspace<T, 3>(size_input);
+        T *current_output = nullptr;
+
+        // adds the accumulated contributions to `current_output`
+        auto write_back = [&]() {
+            if (current_output == nullptr) return;
+            if (is_thread_safe)
+            {
+                for (int j = 0; j < size_input; j++) current_output[j] += accumulator[j];
+            }
+            else
+            {
+                atomic_add_vector(current_output, accumulator, size_input);
+            }
+        };
+
+        // static schedule such that each thread gets contiguous batch elements, likely to share outputs
+        #pragma omp for schedule(static)
+        for (int i = 0; i < nb_batch; i++)
+        {
+            // writes the accumulated contributions back when the output changes
+            T *const output = output_batched[i];
+            if (output != current_output)
+            {
+                write_back();
+                std::fill_n(accumulator, size_input, T{0});
+                current_output = output;
+            }
+
+            // accumulates all the terms for this batch element
+            for (int t = 0; t < term_count; t++)
+            {
+                T const *const *matrix_list = &matrix_list_batched_terms[t][i * matrix_count];
+                T const *const result = kronmult_contract(matrix_count, matrix_size, matrix_list, matrix_stride,
+                                                          input_batched[i], size_input, workspace,
+                                                          workspace2, transpose_workspace);
+                for (int j = 0; j < size_input; j++) accumulator[j] += result[j];
+            }
+        }
+
+        // final write-back
+        write_back();
+    }
+}
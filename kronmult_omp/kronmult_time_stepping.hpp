@@ -0,0 +1,70 @@
+#pragma once
+#include "kronmult_operator.hpp"
+#include <vector>
+
+/*
+ * Explicit time stepping with a `kron_operator`
+ *
+ * the stages of an explicit Runge-Kutta method apply the same operator several times with vector updates in between
+ * here each stage is a single `apply_combination` (y = sum_t c_t v_t + alpha * K x) such that the updates are fused
+ * with the operator applications, and all the stages of a step run within a single parallel region (reusing the
+ * same team of threads, their workspaces and the same static schedule over the vectors)
+ */
+
+/*
+ * one stage: y = sum_t coefficients[t] * vectors[t] + alpha * K x
+ * `vectors` can contain y but x must not alias y
+ */
+template<typename T>
+struct kron_stage
+{
+    T alpha;
+    T const *x;
+    T *y;
+    std::vector<T> coefficients;
+    std::vector<T const *> vectors;
+};
+
+/*
+ * runs `nb_stages` stages in order, within a single parallel region
+ * a stage can use the outputs of the previous stages
+ */
+template<typename T>
+void kron_apply_stages(kron_operator<T> const &op, kron_stage<T> const stages[], int const nb_stages)
+{
+    #pragma omp parallel if (op.is_parallel())
+    {
+        for (int s = 0; s < nb_stages; s++)
+        {
+            kron_stage<T> const &stage = stages[s];
+            op.apply_combination(stage.alpha, stage.x, stage.y, static_cast<int>(stage.coefficients.size()),
+                                 stage.coefficients.data(), stage.vectors.data());
+        }
+    }
+}
+
+/*
+ * advances dx/dt = K x by one step of size `dt` with the classical fourth order Runge-Kutta method
+ *
+ * x_new = x + dt/6 (k1 + 2 k2 + 2 k3 + k4) with k1 = K x, k2 = K (x + dt/2 k1), k3 = K (x + dt/2 k2) and
+ * k4 = K (x + dt k3) is computed from the stage vectors u1 = x + dt/2 k1, u2 = x + dt/2 k2 and u3 = x + dt k3 as
+ * x_new = (u1 + 2 u2 + u3 - x) / 3 + dt/6 K u3, four operator applications and no other sweep over the vectors
+ *
+ * `workspace` is an array of 3*`op.vector_size()` elements, it can be kept from one step to the next
+ * `x_new` can be `x`
+ */
+template<typename T>
+void kron_rk4_step(kron_operator<T> const &op, T const dt, T const x[], T x_new[], T workspace[])
+{
+    size_t const size = op.vector_size();
+    T *const u1       = workspace;
+    T *const u2       = workspace + size;
+    T *const u3       = workspace + 2 * size;
+
+    T const third = T{1} / T{3};
+    kron_stage<T> const stages[] = {{dt / 2, x, u1, {T{1}}, {x}},
+                                    {dt / 2, u1, u2, {T{1}}, {x}},
+                                    {dt, u2, u3, {T{1}}, {x}},
+                                    {dt / 6, u3, x_new, {third, 2 * third, third, -third}, {u1, u2, u3, x}}};
+    kron_apply_stages(op, stages, 4);
+}
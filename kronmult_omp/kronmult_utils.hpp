@@ -0,0 +1,91 @@
+#pragma once
+#include "kronmult_arena.hpp"
+#include <cstddef>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * computes number^power for integers
+ * does not care about performances
+ * does not use std::pow as it does an implicit float conversion that could lead to rounding errors for large
+ * numbers
+ */
+inline int pow_int(int const number, int const power)
+{
+    if (power == 0) return 1;
+    return number * pow_int(number, power - 1);
+}
+
+/*
+ * amount of work (in number of multiply-add) under which `kronmult_batched` runs serially
+ * going parallel costs the startup of the OpenMP team and atomic additions which dominate small batches
+ * it can be overridden at compile time, run `kronmult_latency_bench` (see the tests folder) to find yours
+ *
+ * measured with `kronmult_latency_bench` on a single core Xeon (1 thread): the serial version was faster on all the
+ * sizes of the benchmark (4 to 1.2e7 multiply-add, by 1.2x to 5x, the atomic additions alone costing up to 3x) so
+ * there is no crossover with a single thread, which is thus never used to go parallel
+ * NOTE: the multi-thread value, 65536, could not be measured on that machine and is not validated yet
+ */
+#ifndef KRONMULT_SERIAL_THRESHOLD
+#define KRONMULT_SERIAL_THRESHOLD 65536
+#endif
+
+/*
+ * returns true if a batch of `nb_batch` products is large enough to be run in parallel
+ * small batches are dominated by the cost of going parallel (see `KRONMULT_SERIAL_THRESHOLD`)
+ */
+inline bool kronmult_should_go_parallel(long long const nb_batch, int const matrix_count, int const matrix_size)
+{
+    // a team of a single thread only adds the atomic additions
+#ifdef _OPENMP
+    if (omp_get_max_threads() == 1) return false;
+#else
+    return false;
+#endif
+    long long const work = nb_batch * pow_int(matrix_size, matrix_count) * matrix_size * matrix_count;
+    return work > KRONMULT_SERIAL_THRESHOLD;
+}
+
+/*
+ * adds `source` to `output` in a thread-safe way
+ */
+template<typename T>
+void atomic_add_vector(T output[], T const source[], int const size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        #pragma omp atomic
+        output[i] += source[i];
+    }
+}
+
+/*
+ * returns a buffer of at least `size` elements that is private to the calling thread
+ * the buffer is kept alive, and reused, across calls such that kronmult does not allocate in the common case
+ * it is aligned on `KRONMULT_ALIGNMENT` bytes and, when large, backed by huge pages (see `kronmult_arena.hpp`)
+ * `index` lets a function use several distinct buffers
+ *
+ * WARNING: the content of the buffer is invalidated by the next call with the same type and index
+ */
+template<typename T, int index = 0>
+T *thread_workspace(std::size_t const size)
+{
+    thread_local std::vector<T, kronmult_aligned_allocator<T>> buffer;
+    if (buffer.size() < size) buffer.resize(size);
+    return buffer.data();
+}
+
+/*
+ * returns true if called from within an active OpenMP parallel region
+ * in which case other threads might be writing to the same outputs
+ */
+inline bool is_in_parallel_region()
+{
+#ifdef _OPENMP
+    return omp_in_parallel();
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include "kronmult.hpp"
+#include <algorithm>
+#include <vector>
+
+/*
+ * Skipping the products that are provably zero
+ *
+ * in adaptive runs, many inputs are entirely (freshly refined elements) or mostly zero and some operator
+ * blocks are exactly zero: `kronmult_zero_plan` flags them with a cheap pre-pass such that
+ * `kronmult_batched_skip_zeros` neither computes nor adds to the outputs the work that is known to be zero
+ * - batch elements whose input, or one of whose matrices, is zero are skipped entirely
+ * - the zero slices of an input along its outermost dimension (that of the first matrix) are not contracted
+ *
+ * WARNING: skipped products are assumed to be zero, an infinite or NaN coefficient multiplied by a zero is
+ * thus not propagated to the outputs
+ */
+
+/*
+ * returns true if all the `nb_rows` by `nb_cols` coefficients of the col-major matrix `matrix` are zero
+ * stops at the first nonzero coefficient, which makes the test cheap on dense data
+ */
+template<typename T>
+bool kronmult_is_zero(T const matrix[], int const nb_rows, int const nb_cols, int const stride)
+{
+    for (int col = 0; col < nb_cols; col++)
+    {
+        for (int row = 0; row < nb_rows; row++)
+        {
+            if (matrix[row + col * stride] != T{0}) return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * zero inputs, matrices and input slices of a batch
+ *
+ * the plan can be kept from one call to the next as long as the matrices do not change, `update_inputs` then
+ * only scans the new inputs
+ *
+ * WARNING: `kronmult_batched_skip_zeros` uses the inputs as workspaces, the plan must thus be updated after
+ * the inputs are refilled
+ */
+class kronmult_zero_plan
+{
+  public:
+    /*
+     * scans the matrices and inputs of a batch, in parallel
+     * the arguments have the same meaning as for `kronmult_batched`
+     */
+    template<typename T>
+    kronmult_zero_plan(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                       int const matrix_stride, T const *const input_batched[], int const nb_batch)
+        : matrix_count(matrix_count), matrix_size(matrix_size), nb_batch(nb_batch), has_zero_matrix(nb_batch),
+          nonzero_slices(static_cast<size_t>(nb_batch) * matrix_size), nb_nonzero_slices_(nb_batch)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < nb_batch; i++)
+        {
+            T const *const *matrix_list = &matrix_list_batched[static_cast<size_t>(i) * matrix_count];
+            bool is_zero                = false;
+            for (int m = 0; (m < matrix_count) and (not is_zero); m++)
+            {
+                is_zero = kronmult_is_zero(matrix_list[m], matrix_size, matrix_size, matrix_stride);
+            }
+            has_zero_matrix[i] = is_zero;
+        }
+
+        update_inputs(input_batched);
+    }
+
+    /*
+     * scans the inputs again, the matrices being unchanged
+     */
+    template<typename T>
+    void update_inputs(T const *const input_batched[])
+    {
+        int const size_slice = pow_int(matrix_size, matrix_count - 1);
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < nb_batch; i++)
+        {
+            // an input is seen as `matrix_size` contiguous slices of `size_slice` elements
+            int nb_nonzero = 0;
+            for (int c = 0; c < matrix_size; c++)
+            {
+                T const *const slice = &input_batched[i][static_cast<size_t>(c) * size_slice];
+                bool const is_nonzero = not kronmult_is_zero(slice, size_slice, 1, size_slice);
+                nonzero_slices[static_cast<size_t>(i) * matrix_size + c] = is_nonzero;
+                if (is_nonzero) nb_nonzero++;
+            }
+            nb_nonzero_slices_[i] = nb_nonzero;
+        }
+    }
+
+    // true if the product of batch element `i` is zero
+    bool is_skipped(int const i) const { return has_zero_matrix[i] or (nb_nonzero_slices_[i] == 0); }
+
+    // number of nonzero slices in the input of batch element `i`
+    int nb_nonzero_slices(int const i) const { return nb_nonzero_slices_[i]; }
+
+    // true if the slice `c` of the input of batch element `i` is nonzero
+    bool is_nonzero_slice(int const i, int const c) const
+    {
+        return nonzero_slices[static_cast<size_t>(i) * matrix_size + c];
+    }
+
+    // number of batch elements whose input is zero
+    int nb_zero_inputs() const
+    {
+        return static_cast<int>(std::count(nb_nonzero_slices_.begin(), nb_nonzero_slices_.end(), 0));
+    }
+
+    // number of batch elements with at least one zero matrix
+    int nb_zero_matrices() const
+    {
+        return static_cast<int>(std::count(has_zero_matrix.begin(), has_zero_matrix.end(), 1));
+    }
+
+    // number of batch elements that are skipped, because of a zero input or matrix
+    int nb_skipped_elements() const
+    {
+        int nb_skipped = 0;
+        for (int i = 0; i < nb_batch; i++)
+        {
+            if (is_skipped(i)) nb_skipped++;
+        }
+        return nb_skipped;
+    }
+
+    // number of zero input slices that are skipped within the batch elements that are not skipped entirely
+    long long nb_skipped_slices() const
+    {
+        long long nb_skipped = 0;
+        for (int i = 0; i < nb_batch; i++)
+        {
+            if (not is_skipped(i)) nb_skipped += matrix_size - nb_nonzero_slices_[i];
+        }
+        return nb_skipped;
+    }
+
+    /*
+     * fraction of the multiply-adds of `kronmult_batched` that are skipped
+     * the work of a batch element is proportional to its number of nonzero slices
+     */
+    double skip_rate() const
+    {
+        if (nb_batch == 0) return 0.;
+        double const total_slices = static_cast<double>(nb_batch) * matrix_size;
+        double const skipped_slices =
+            static_cast<double>(nb_skipped_elements()) * matrix_size + nb_skipped_slices();
+        return skipped_slices / total_slices;
+    }
+
+  private:
+    int matrix_count;
+    int matrix_size;
+    int nb_batch;
+    // true if one of the matrices of the batch element is zero
+    // (stored as `char` rather than `bool` such that different threads can write neighbouring elements)
+    std::vector<char> has_zero_matrix;
+    // true at `i`*`matrix_size`+`c` if the slice c of input i is nonzero
+    std::vector<char> nonzero_slices;
+    std::vector<int> nb_nonzero_slices_;
+};
+
+/*
+ * Computes output[K] += kron(matrix_list[K]) * input[K] for 0 <= k < batchCount, skipping the work flagged as
+ * zero by `plan` (which should describe the current matrices and inputs)
+ *
+ * takes the same arguments as `kronmult_batched`
+ * a batch element whose input has zero slices contracts its nonzero slices with all the matrices but the
+ * first one, the first matrix then combines the contracted slices into the output
+ */
+template<typename T>
+void kronmult_batched_skip_zeros(int const matrix_count, int const matrix_size,
+                                 T const *const matrix_list_batched[], int const matrix_stride,
+                                 T *input_batched[], T *output_batched[], T *workspace_batched[],
+                                 int const nb_batch, kronmult_zero_plan const &plan)
+{
+    // numbers of elements in the input vector and in one of its slices along the outermost dimension
+    int const size_input = pow_int(matrix_size, matrix_count);
+    int const size_slice = size_input / matrix_size;
+
+    // only the remaining work is counted to decide whether to go parallel
+    long long const remaining_batch = static_cast<long long>((1. - plan.skip_rate()) * nb_batch);
+    bool const is_parallel          = kronmult_should_go_parallel(remaining_batch, matrix_count, matrix_size);
+
+    // are other threads potentially writing to the outputs
+    bool const is_thread_safe = (not is_parallel) and (not is_in_parallel_region());
+
+    #pragma omp parallel if (is_parallel)
+    {
+        // workspaces, allocated once per thread and reused from one call to the next
+        T *const transpose_workspace = thread_workspace<T, 0>(matrix_size * matrix_size);
+        T *const slice_workspace     = thread_workspace<T, 1>(size_slice);
+        T *const result_workspace    = thread_workspace<T, 2>(size_input);
+
+        // the amount of work varies from one batch element to the other
+        #pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < nb_batch; i++)
+        {
+            if (plan.is_skipped(i)) continue;
+            T const *const *matrix_list = &matrix_list_batched[static_cast<size_t>(i) * matrix_count];
+            T *const input              = input_batched[i];
+            T *const output             = output_batched[i];
+
+            T const *result;
+            if (plan.nb_nonzero_slices(i) == matrix_size)
+            {
+                result = kronmult_contract<T>(matrix_count, matrix_size, matrix_list, matrix_stride, input,
+                                              size_input, workspace_batched[i], input, transpose_workspace);
+            }
+            else
+            {
+                // kron(A,B) x = [sum_c A[r,c] kron(B) x_c]_r where x_c is the slice c of x
+                T const *const first_matrix = matrix_list[0];
+                std::fill_n(result_workspace, size_input, T{0});
+                for (int c = 0; c < matrix_size; c++)
+                {
+                    if (not plan.is_nonzero_slice(i, c)) continue;
+                    T *const slice = &input[static_cast<size_t>(c) * size_slice];
+                    T const *const contracted_slice =
+                        kronmult_contract<T>(matrix_count - 1, matrix_size, matrix_list + 1, matrix_stride,
+                                             slice, size_slice, slice_workspace, slice, transpose_workspace);
+                    for (int r = 0; r < matrix_size; r++)
+                    {
+                        T const coefficient   = first_matrix[r + c * matrix_stride];
+                        T *const result_slice = &result_workspace[static_cast<size_t>(r) * size_slice];
+                        for (int j = 0; j < size_slice; j++)
+                        {
+                            result_slice[j] += coefficient * contracted_slice[j];
+                        }
+                    }
+                }
+                result = result_workspace;
+            }
+
+            if (is_thread_safe)
+            {
+                for (int j = 0; j < size_input; j++) output[j] += result[j];
+            }
+            else
+            {
+                atomic_add_vector(output, result, size_input);
+            }
+        }
+    }
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "kronmult_dispatch.hpp"
 #include <stdexcept>
 
 #ifdef KRONMULT_USE_BLAS
@@ -21,14 +22,17 @@ extern "C"
  *
  * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
  * M is a `size_M` by `size_M` matrix of stride `stride_M`
- * Y is a `nb_col_X` by `size_M` matrix of stride `nb_col_X`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `stride_Y` (at least `nb_col_X`)
  * M_transposed is a `size_M` by `size_M` matrix of stride `size_M` (it is ignored in this specialization)
  *
+ * the stride lets several threads fill the rows of Y that correspond to disjoint sets of columns of X
+ *
  * WARNING: the matrices are assumed to be stored in col-major order
  */
 template<typename T>
-void multiply_transpose(T const X_const[], int const nb_col_X_const, T const M_const[],
-                        int const size_M_const, int const stride_M_const, T Y[], T[])
+void multiply_transpose_strided(T const X_const[], int const nb_col_X_const, T const M_const[],
+                                int const size_M_const, int const stride_M_const, T Y[], int const stride_Y_const,
+                                T[])
 {
     // drops some const qualifiers as requested by BLAS
     auto X       = const_cast<T *>(X_const);
@@ -36,6 +40,7 @@ void multiply_transpose(T const X_const[], int const nb_col_X_const, T const M_c
     int nb_col_X = nb_col_X_const;
     int size_M   = size_M_const;
     int stride_M = stride_M_const;
+    int stride_Y = stride_Y_const;
     // Y = weight_XM * X^T * M^T + weight_Y * Y
     char should_transpose_X = 'T';
     char should_transpose_M = 'T';
@@ -45,17 +50,208 @@ void multiply_transpose(T const X_const[], int const nb_col_X_const, T const M_c
     if constexpr (std::is_same<T, float>::value)
     {
         sgemm_(&should_transpose_X, &should_transpose_M, &nb_col_X, &size_M, &size_M, &weight_XM, X, &size_M,
-               M, &stride_M, &weight_Y, Y, &nb_col_X);
+               M, &stride_M, &weight_Y, Y, &stride_Y);
     }
     else if constexpr (std::is_same<T, double>::value)
     {
         dgemm_(&should_transpose_X, &should_transpose_M, &nb_col_X, &size_M, &size_M, &weight_XM, X, &size_M,
-               M, &stride_M, &weight_Y, Y, &nb_col_X);
+               M, &stride_M, &weight_Y, Y, &stride_Y);
     }
     static_assert(std::is_same<T, double>::value or std::is_same<T, float>::value,
                   "The function `multiply_transpose` is only defined for float and double precision");
 }
 
+/*
+ * Computes Y = X^T * M^T
+ *
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `nb_col_X`
+ * M_transposed is a `size_M` by `size_M` matrix of stride `size_M` (it is ignored in this specialization)
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_transpose(T const X[], int const nb_col_X, T const M[], int const size_M, int const stride_M,
+                        T Y[], T M_transposed[])
+{
+    multiply_transpose_strided(X, nb_col_X, M, size_M, stride_M, Y, nb_col_X, M_transposed);
+}
+
+/*
+ * Computes Y = X^T * M
+ * this is `multiply_transpose_strided` applied to M^T, used to apply transposed kronecker products without copies
+ *
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `stride_Y` (at least `nb_col_X`)
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_transpose_X_strided(T const X_const[], int const nb_col_X_const, T const M_const[],
+                                  int const size_M_const, int const stride_M_const, T Y[], int const stride_Y_const)
+{
+    // drops some const qualifiers as requested by BLAS
+    auto X       = const_cast<T *>(X_const);
+    auto M       = const_cast<T *>(M_const);
+    int nb_col_X = nb_col_X_const;
+    int size_M   = size_M_const;
+    int stride_M = stride_M_const;
+    int stride_Y = stride_Y_const;
+    // Y = weight_XM * X^T * M + weight_Y * Y
+    char should_transpose_X = 'T';
+    char should_transpose_M = 'N';
+    T weight_XM             = 1.0;
+    T weight_Y              = 0.0;
+    // calls the proper specialization
+    if constexpr (std::is_same<T, float>::value)
+    {
+        sgemm_(&should_transpose_X, &should_transpose_M, &nb_col_X, &size_M, &size_M, &weight_XM, X, &size_M,
+               M, &stride_M, &weight_Y, Y, &stride_Y);
+    }
+    else if constexpr (std::is_same<T, double>::value)
+    {
+        dgemm_(&should_transpose_X, &should_transpose_M, &nb_col_X, &size_M, &size_M, &weight_XM, X, &size_M,
+               M, &stride_M, &weight_Y, Y, &stride_Y);
+    }
+    static_assert(std::is_same<T, double>::value or std::is_same<T, float>::value,
+                  "The function `multiply_transpose_X` is only defined for float and double precision");
+}
+
+/*
+ * Computes Y = X^T * M
+ * this is `multiply_transpose` applied to M^T, used to apply transposed kronecker products without copies
+ *
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `nb_col_X`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_transpose_X(T const X[], int const nb_col_X, T const M[], int const size_M, int const stride_M, T Y[])
+{
+    multiply_transpose_X_strided(X, nb_col_X, M, size_M, stride_M, Y, nb_col_X);
+}
+
+/*
+ * Computes C = A * B
+ *
+ * A is a `nb_row_A` by `size_inner` matrix of stride `nb_row_A`
+ * B is a `size_inner` by `nb_col_B` matrix of stride `size_inner`
+ * C is a `nb_row_A` by `nb_col_B` matrix of stride `nb_row_A`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply(T const A_const[], T const B_const[], T C[], int const nb_row_A_const, int const nb_col_B_const,
+              int const size_inner_const)
+{
+    // drops some const qualifiers as requested by BLAS
+    auto A         = const_cast<T *>(A_const);
+    auto B         = const_cast<T *>(B_const);
+    int nb_row_A   = nb_row_A_const;
+    int nb_col_B   = nb_col_B_const;
+    int size_inner = size_inner_const;
+    // C = weight_AB * A * B + weight_C * C
+    char should_transpose = 'N';
+    T weight_AB           = 1.0;
+    T weight_C            = 0.0;
+    // calls the proper specialization
+    if constexpr (std::is_same<T, float>::value)
+    {
+        sgemm_(&should_transpose, &should_transpose, &nb_row_A, &nb_col_B, &size_inner, &weight_AB, A, &nb_row_A,
+               B, &size_inner, &weight_C, C, &nb_row_A);
+    }
+    else if constexpr (std::is_same<T, double>::value)
+    {
+        dgemm_(&should_transpose, &should_transpose, &nb_row_A, &nb_col_B, &size_inner, &weight_AB, A, &nb_row_A,
+               B, &size_inner, &weight_C, C, &nb_row_A);
+    }
+    static_assert(std::is_same<T, double>::value or std::is_same<T, float>::value,
+                  "The function `multiply` is only defined for float and double precision");
+}
+
+/*
+ * Computes Y += M * X
+ * applies M along the fastest index of X (its rows), used by Kronecker sums
+ *
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * Y is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_add(T const M_const[], int const size_M_const, int const stride_M_const, T const X_const[],
+                  int const nb_col_X_const, T Y[])
+{
+    // drops some const qualifiers as requested by BLAS
+    auto M       = const_cast<T *>(M_const);
+    auto X       = const_cast<T *>(X_const);
+    int size_M   = size_M_const;
+    int stride_M = stride_M_const;
+    int nb_col_X = nb_col_X_const;
+    // Y = weight_MX * M * X + weight_Y * Y
+    char should_transpose = 'N';
+    T weight_MX           = 1.0;
+    T weight_Y            = 1.0;
+    // calls the proper specialization
+    if constexpr (std::is_same<T, float>::value)
+    {
+        sgemm_(&should_transpose, &should_transpose, &size_M, &nb_col_X, &size_M, &weight_MX, M, &stride_M, X,
+               &size_M, &weight_Y, Y, &size_M);
+    }
+    else if constexpr (std::is_same<T, double>::value)
+    {
+        dgemm_(&should_transpose, &should_transpose, &size_M, &nb_col_X, &size_M, &weight_MX, M, &stride_M, X,
+               &size_M, &weight_Y, Y, &size_M);
+    }
+    static_assert(std::is_same<T, double>::value or std::is_same<T, float>::value,
+                  "The function `multiply_add` is only defined for float and double precision");
+}
+
+/*
+ * Computes Y += X * M^T
+ * applies M along the slowest index of X (its columns), used by Kronecker sums
+ *
+ * X is a `nb_row_X` by `size_M` matrix of stride `nb_row_X`
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * Y is a `nb_row_X` by `size_M` matrix of stride `nb_row_X`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_add_transpose(T const X_const[], int const nb_row_X_const, T const M_const[], int const size_M_const,
+                            int const stride_M_const, T Y[])
+{
+    // drops some const qualifiers as requested by BLAS
+    auto X       = const_cast<T *>(X_const);
+    auto M       = const_cast<T *>(M_const);
+    int nb_row_X = nb_row_X_const;
+    int size_M   = size_M_const;
+    int stride_M = stride_M_const;
+    // Y = weight_XM * X * M^T + weight_Y * Y
+    char should_transpose_X = 'N';
+    char should_transpose_M = 'T';
+    T weight_XM             = 1.0;
+    T weight_Y              = 1.0;
+    // calls the proper specialization
+    if constexpr (std::is_same<T, float>::value)
+    {
+        sgemm_(&should_transpose_X, &should_transpose_M, &nb_row_X, &size_M, &size_M, &weight_XM, X, &nb_row_X,
+               M, &stride_M, &weight_Y, Y, &nb_row_X);
+    }
+    else if constexpr (std::is_same<T, double>::value)
+    {
+        dgemm_(&should_transpose_X, &should_transpose_M, &nb_row_X, &size_M, &size_M, &weight_XM, X, &nb_row_X,
+               M, &stride_M, &weight_Y, Y, &nb_row_X);
+    }
+    static_assert(std::is_same<T, double>::value or std::is_same<T, float>::value,
+                  "The function `multiply_add_transpose` is only defined for float and double precision");
+}
+
 #else
 
 /*
@@ -92,16 +288,18 @@ void transpose(T const input[], T output[], int const matrix_size, int const inp
  *
  * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
  * M is a `size_M` by `size_M` matrix of stride `stride_M`
- * Y is a `nb_col_X` by `size_M` matrix of stride `nb_col_X`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `stride_Y` (at least `nb_col_X`)
  * M_transposed is a `size_M` by `size_M` matrix of stride `size_M` that will be used to store M^T temporarily
  *
+ * the stride lets several threads fill the rows of Y that correspond to disjoint sets of columns of X
+ *
  * WARNING:
  * the matrices are assumed to be stored in col-major order
  * `transpose_workspace` will be used as temporary workspaces and thus modified
  */
 template<typename T>
-void multiply_transpose(T const X[], int const nb_col_X, T const M[], int const size_M, int const stride_M,
-                        T Y[], T M_transposed[])
+void multiply_transpose_strided_kernel(T const X[], int const nb_col_X, T const M[], int const size_M,
+                                       int const stride_M, T Y[], int const stride_Y, T M_transposed[])
 {
     // transpose the matrix to get a better cache behaviour
     transpose(M, M_transposed, size_M, stride_M);
@@ -115,9 +313,199 @@ void multiply_transpose(T const X[], int const nb_col_X, T const M[], int const
             {
                 dotprod += X[colmajor(k, colX, size_M)] * M_transposed[colmajor(k, rowM, size_M)];
             }
-            Y[colmajor(colX, rowM, nb_col_X)] = dotprod;
+            Y[colmajor(colX, rowM, stride_Y)] = dotprod;
+        }
+    }
+}
+
+/*
+ * `multiply_transpose_strided_kernel` compiled for the instruction set of the CPU (see `kronmult_dispatch.hpp`)
+ */
+template<typename T>
+void multiply_transpose_strided(T const X[], int const nb_col_X, T const M[], int const size_M,
+                                int const stride_M, T Y[], int const stride_Y, T M_transposed[])
+{
+    kronmult_dispatch<multiply_transpose_strided_kernel<T>>(X, nb_col_X, M, size_M, stride_M, Y, stride_Y,
+                                                            M_transposed);
+}
+
+/*
+ * Computes Y = X^T * M^T
+ *
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `nb_col_X`
+ * M_transposed is a `size_M` by `size_M` matrix of stride `size_M` that will be used to store M^T temporarily
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_transpose(T const X[], int const nb_col_X, T const M[], int const size_M, int const stride_M,
+                        T Y[], T M_transposed[])
+{
+    multiply_transpose_strided(X, nb_col_X, M, size_M, stride_M, Y, nb_col_X, M_transposed);
+}
+
+/*
+ * Computes Y = X^T * M
+ * this is `multiply_transpose_strided` applied to M^T, used to apply transposed kronecker products without copies
+ *
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `stride_Y` (at least `nb_col_X`)
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_transpose_X_strided_kernel(T const X[], int const nb_col_X, T const M[], int const size_M,
+                                         int const stride_M, T Y[], int const stride_Y)
+{
+    // the columns of M are contiguous, no transposition is needed to get a good cache behaviour
+    for (int colX = 0; colX < nb_col_X; colX++)
+    {
+        for (int colM = 0; colM < size_M; colM++)
+        {
+            T dotprod = 0.;
+            for (int k = 0; k < size_M; k++)
+            {
+                dotprod += X[colmajor(k, colX, size_M)] * M[colmajor(k, colM, stride_M)];
+            }
+            Y[colmajor(colX, colM, stride_Y)] = dotprod;
+        }
+    }
+}
+
+/*
+ * `multiply_transpose_X_strided_kernel` compiled for the instruction set of the CPU (see `kronmult_dispatch.hpp`)
+ */
+template<typename T>
+void multiply_transpose_X_strided(T const X[], int const nb_col_X, T const M[], int const size_M,
+                                  int const stride_M, T Y[], int const stride_Y)
+{
+    kronmult_dispatch<multiply_transpose_X_strided_kernel<T>>(X, nb_col_X, M, size_M, stride_M, Y, stride_Y);
+}
+
+/*
+ * Computes Y = X^T * M
+ * this is `multiply_transpose` applied to M^T, used to apply transposed kronecker products without copies
+ *
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * Y is a `nb_col_X` by `size_M` matrix of stride `nb_col_X`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_transpose_X(T const X[], int const nb_col_X, T const M[], int const size_M, int const stride_M, T Y[])
+{
+    multiply_transpose_X_strided(X, nb_col_X, M, size_M, stride_M, Y, nb_col_X);
+}
+
+/*
+ * Computes C = A * B
+ *
+ * A is a `nb_row_A` by `size_inner` matrix of stride `nb_row_A`
+ * B is a `size_inner` by `nb_col_B` matrix of stride `size_inner`
+ * C is a `nb_row_A` by `nb_col_B` matrix of stride `nb_row_A`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_kernel(T const A[], T const B[], T C[], int const nb_row_A, int const nb_col_B, int const size_inner)
+{
+    // column by column, such that all accesses are contiguous
+    for (int colB = 0; colB < nb_col_B; colB++)
+    {
+        T *const column_C = &C[colmajor(0, colB, nb_row_A)];
+        for (int row = 0; row < nb_row_A; row++) column_C[row] = 0.;
+        for (int k = 0; k < size_inner; k++)
+        {
+            T const weight          = B[colmajor(k, colB, size_inner)];
+            T const *const column_A = &A[colmajor(0, k, nb_row_A)];
+            for (int row = 0; row < nb_row_A; row++) column_C[row] += weight * column_A[row];
         }
     }
 }
 
-#endif
\ No newline at end of file
+/*
+ * `multiply_kernel` compiled for the instruction set of the CPU (see `kronmult_dispatch.hpp`)
+ */
+template<typename T>
+void multiply(T const A[], T const B[], T C[], int const nb_row_A, int const nb_col_B, int const size_inner)
+{
+    kronmult_dispatch<multiply_kernel<T>>(A, B, C, nb_row_A, nb_col_B, size_inner);
+}
+
+/*
+ * Computes Y += M * X
+ * applies M along the fastest index of X (its rows), used by Kronecker sums
+ *
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * Y is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_add_kernel(T const M[], int const size_M, int const stride_M, T const X[], int const nb_col_X, T Y[])
+{
+    // column by column, such that all accesses are contiguous
+    for (int colX = 0; colX < nb_col_X; colX++)
+    {
+        T *const column_Y = &Y[colmajor(0, colX, size_M)];
+        for (int k = 0; k < size_M; k++)
+        {
+            T const weight          = X[colmajor(k, colX, size_M)];
+            T const *const column_M = &M[colmajor(0, k, stride_M)];
+            for (int row = 0; row < size_M; row++) column_Y[row] += weight * column_M[row];
+        }
+    }
+}
+
+/*
+ * `multiply_add_kernel` compiled for the instruction set of the CPU (see `kronmult_dispatch.hpp`)
+ */
+template<typename T>
+void multiply_add(T const M[], int const size_M, int const stride_M, T const X[], int const nb_col_X, T Y[])
+{
+    kronmult_dispatch<multiply_add_kernel<T>>(M, size_M, stride_M, X, nb_col_X, Y);
+}
+
+/*
+ * Computes Y += X * M^T
+ * applies M along the slowest index of X (its columns), used by Kronecker sums
+ *
+ * X is a `nb_row_X` by `size_M` matrix of stride `nb_row_X`
+ * M is a `size_M` by `size_M` matrix of stride `stride_M`
+ * Y is a `nb_row_X` by `size_M` matrix of stride `nb_row_X`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void multiply_add_transpose_kernel(T const X[], int const nb_row_X, T const M[], int const size_M,
+                                   int const stride_M, T Y[])
+{
+    // column by column, such that all accesses are contiguous
+    for (int rowM = 0; rowM < size_M; rowM++)
+    {
+        T *const column_Y = &Y[colmajor(0, rowM, nb_row_X)];
+        for (int k = 0; k < size_M; k++)
+        {
+            T const weight          = M[colmajor(rowM, k, stride_M)];
+            T const *const column_X = &X[colmajor(0, k, nb_row_X)];
+            for (int row = 0; row < nb_row_X; row++) column_Y[row] += weight * column_X[row];
+        }
+    }
+}
+
+/*
+ * `multiply_add_transpose_kernel` compiled for the instruction set of the CPU (see `kronmult_dispatch.hpp`)
+ */
+template<typename T>
+void multiply_add_transpose(T const X[], int const nb_row_X, T const M[], int const size_M, int const stride_M,
+                            T Y[])
+{
+    kronmult_dispatch<multiply_add_transpose_kernel<T>>(X, nb_row_X, M, size_M, stride_M, Y);
+}
+
+#endif
@@ -0,0 +1,208 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+/*
+ * Kronmult with OpenMP offloading
+ *
+ * this is a port of the CUDA implementation (see `kronmult_gpu`) to the OpenMP `target` construct:
+ * each batch element is processed by a team (a CUDA block) whose threads (the threads of the block) share the loops
+ * over the elements of the input, the worksharing loops being cyclic (as the CUDA strided loops) and their implicit
+ * barriers standing for the `__syncthreads`
+ *
+ * without an offloading device (or if the code was not compiled for one) the target region runs on the host, the teams
+ * being processed one after the other by the threads of the current OpenMP context
+ */
+
+// maximum size of the matrices, the transposed matrix is stored in a fixed size array private to the team
+// (the equivalent of CUDA's shared memory)
+#ifndef KRONMULT_TARGET_MAX_MATRIX_SIZE
+#define KRONMULT_TARGET_MAX_MATRIX_SIZE 32
+#endif
+
+// maximum number of threads per team, the equivalent of CUDA's maximum number of threads per block
+#ifndef KRONMULT_TARGET_MAX_TEAM_THREADS
+#define KRONMULT_TARGET_MAX_TEAM_THREADS 1024
+#endif
+
+#pragma omp declare target
+
+/*
+ * converts row and col indices into a single index for a matrix stored in col-major
+ * `stride` is usually the number of rows of the matrix
+ */
+constexpr int target_colmajor(int const row, int const col, int const stride)
+{
+    return row + col * stride;
+}
+
+/*
+ * computes output = input^T
+ * must be called by all the threads of a team, the elements being shared between them
+ *
+ * `input` is a `matrix_size` by `matrix_size` square matrix of stride `input_stride`
+ * `output` is a `matrix_size` by `matrix_size` square matrix of stride `matrix_size`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void target_transpose(T const input[], T output[], int const matrix_size, int const input_stride)
+{
+    #pragma omp for schedule(static, 1)
+    for (int i = 0; i < matrix_size * matrix_size; i++)
+    {
+        int const c                                = i / matrix_size;
+        int const r                                = i - c * matrix_size;
+        output[target_colmajor(r, c, matrix_size)] = input[target_colmajor(c, r, input_stride)];
+    }
+}
+
+/*
+ * Computes Y = X^T * M^T
+ * must be called by all the threads of a team, the elements of Y being shared between them
+ *
+ * X is a `size_M` by `nb_col_X` matrix of stride `size_M`
+ * M_transposed is a `size_M` by `size_M` matrix of stride `size_M` that contains a precomputed M^T
+ * Y is a `nb_col_X` by `size_M` matrix of stride `nb_col_X`
+ *
+ * WARNING: the matrices are assumed to be stored in col-major order
+ */
+template<typename T>
+void target_multiply_transpose(T const X[], int const nb_col_X, T const M_transposed[], int const size_M, T Y[])
+{
+    // cyclic distribution, consecutive threads read consecutive rows of M_transposed
+    #pragma omp for schedule(static, 1)
+    for (int i = 0; i < nb_col_X * size_M; i++)
+    {
+        // extracts the column and row number for the current element
+        int const colX = i / size_M;
+        int const rowM = i - colX * size_M;
+
+        // computes the dot product to fill the [colX,rowM] cell of the matrix
+        T dotprod = 0.;
+        for (int k = 0; k < size_M; k++)
+        {
+            dotprod += X[target_colmajor(k, colX, size_M)] * M_transposed[target_colmajor(k, rowM, size_M)];
+        }
+
+        Y[target_colmajor(colX, rowM, nb_col_X)] = dotprod;
+    }
+}
+
+/*
+ * Computes output += kron(matrix_list) * input while insuring that the addition to output is thread-safe
+ * must be called by all the threads of a team
+ *
+ * `matrix_list` is an array containing pointers to `matrix_number` square matrices of size `matrix_size` by
+ * `matrix_size` and stride `matrix_stride` `input` is a `size_input` (`matrix_size`^`matrix_number`) elements
+ * vector `output` is a `size_input` elements vector, to which the output of the multiplication will be added
+ * `workspace` is a `size_input` elements vector, to be used as workspace
+ * `transpose_workspace` is a vector of size `matrix_size`*`matrix_size`, shared by the team, to store transposed
+ * matrices temporarily
+ *
+ * WARNINGS:
+ * - `input`, `workspace` and `transpose_workspace` will be used as temporary workspaces and thus modified
+ * - the matrices are assumed to be stored in col-major order
+ * - the sizes are assumed to be correct
+ */
+template<typename T>
+void target_kronmult(int const matrix_count, int const matrix_size, T const *const matrix_list[],
+                     int const matrix_stride, T input[], int const size_input, T output[], T workspace[],
+                     T transpose_workspace[])
+{
+    // how many column should `input` have for the multiplications to be legal
+    int const nb_col_input = size_input / matrix_size;
+
+    // iterates on the matrices from last to first
+    for (int i = matrix_count - 1; i >= 0; i--)
+    {
+        // transpose the matrix to get a better memory coalescing
+        // (the implicit barrier at the end of the loop makes it visible to the whole team)
+        T const *const matrix = matrix_list[i];
+        target_transpose(matrix, transpose_workspace, matrix_size, matrix_stride);
+
+        // performs the multiplication to consume the matrix
+        target_multiply_transpose<T>(input, nb_col_input, transpose_workspace, matrix_size, workspace);
+
+        // swap `input` and `workspace` such that `input` contains once again the input
+        // note that, while they have the same size flattened, the shape (nb_columns and nb_rows) of `input`
+        // and `workspace` *are* different this is on purpose and equivalent to a reshape operation that is
+        // actually needed by the algorithm
+        T *temp   = input;
+        input     = workspace;
+        workspace = temp;
+    }
+
+    // adds result to output in a thread-safe way
+    #pragma omp for schedule(static, 1)
+    for (int i = 0; i < size_input; i++)
+    {
+        #pragma omp atomic
+        output[i] += input[i];
+    }
+}
+
+#pragma omp end declare target
+
+/*
+ * Computes output[K] += kron(matrix_list[K]) * input[K] for 0 <= k < batchCount
+ * assuming that some of the output pointers will be equal requiring a thread-safe addition
+ *
+ * `matrix_list_batched` is an array of `nb_batch`*`matrix_count` pointers to square matrices of size
+ * `matrix_size` by `matrix_size` and stride `matrix_stride` `input_batched` is an array of `nb_batch`
+ * pointers to array of size `matrix_size`^`matrix_count` `output_batched` is an array of `nb_batch` pointers
+ * to array of size `matrix_size`^`matrix_count`, to which the outputs will be added `workspace` is an array
+ * of `nb_batch` pointers to array of size `matrix_size`^`matrix_count`, to be used as workspaces
+ *
+ * runs on the default device (`omp_get_default_device()`), one team per batch element
+ * throws an `std::invalid_argument` if `matrix_size` is larger than `KRONMULT_TARGET_MAX_MATRIX_SIZE`
+ *
+ * WARNINGS:
+ * - we assume that all the arrays, including the arrays of pointers, have already been allocated *on the default
+ *   device* (using `omp_target_alloc` for example, which falls back to host memory when there is no device)
+ * - `input_batched` and `workspace_batched` will be used as temporary workspaces and thus modified
+ * - the matrices are assumed to be stored in col-major order
+ * - the sizes are assumed to be correct
+ */
+template<typename T>
+void kronmult_batched_target(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                             int const matrix_stride, T *input_batched[], T *output_batched[],
+                             T *workspace_batched[], int const nb_batch)
+{
+    if (matrix_size > KRONMULT_TARGET_MAX_MATRIX_SIZE)
+    {
+        throw std::invalid_argument("kronmult_batched_target: matrix_size (" + std::to_string(matrix_size)
+                                    + ") is larger than KRONMULT_TARGET_MAX_MATRIX_SIZE");
+    }
+    if (nb_batch <= 0) return;
+
+    // numbers of elements in the input vector
+    int size_input = 1;
+    for (int i = 0; i < matrix_count; i++) size_input *= matrix_size;
+
+    // each team will take care of a single batch element
+    // the threads within a team will loop over input_size
+    int const nb_threads = std::min(size_input, KRONMULT_TARGET_MAX_TEAM_THREADS);
+
+    // parallelize over batch elements
+    #pragma omp target teams distribute num_teams(nb_batch) thread_limit(nb_threads) \
+        is_device_ptr(matrix_list_batched, input_batched, output_batched, workspace_batched)
+    for (int batchId = 0; batchId < nb_batch; batchId++)
+    {
+        // gets the inputs for a given batch element
+        T const *const *matrix_list = &matrix_list_batched[static_cast<size_t>(batchId) * matrix_count];
+        T *const input              = input_batched[batchId];
+        T *const output             = output_batched[batchId];
+        T *const workspace          = workspace_batched[batchId];
+
+        // private to the team and shared by its threads
+        T transpose_workspace[KRONMULT_TARGET_MAX_MATRIX_SIZE * KRONMULT_TARGET_MAX_MATRIX_SIZE];
+
+        // does the kronmult computations
+        #pragma omp parallel
+        target_kronmult<T>(matrix_count, matrix_size, matrix_list, matrix_stride, input, size_input, output,
+                           workspace, transpose_workspace);
+    }
+}
@@ -1,20 +1,61 @@
+#include "utils/bench_sparse_grid.h"
+#include "utils/kronmult_reference.h"
 #include "utils/utils_cpu.h"
+#include "utils/workload.h"
 #include <chrono>
 #include <iostream>
 #include <kronmult.hpp>
+#include <kronmult_capture.hpp>
+#include <kronmult_streaming.hpp>
+#include <kronmult_sum.hpp>
+#include <kronmult_terms.hpp>
 #include "utils/batch_size.h"
 #include <omp.h>
+#include <utility>
 
 // change this to run the bench in another precision
 using Number = double;
 
+// signature shared by `kronmult_batched` and the implementations it dispatches to
+using KronmultFunction = void(int const, int const, Number const *const[], int const, Number *[], Number *[],
+                              Number *[], int const);
+
+/*
+ * `kronmult_batched_teams` with teams of `team_size` threads, whatever `KRONMULT_TEAM_SIZE` is
+ */
+template<int team_size>
+void kronmult_batched_teams_of(int const matrix_count, int const matrix_size, Number const *const matrix_list_batched[],
+                               int const matrix_stride, Number *input_batched[], Number *output_batched[],
+                               Number *workspace_batched[], int const nb_batch)
+{
+    kronmult_batched_teams<Number>(matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched,
+                                   output_batched, workspace_batched, nb_batch, team_size);
+}
+
+// set by the `--arena` flag, allocates the vectors of the benchmarks in a `kronmult_arena` (aligned, with huge pages)
+bool use_arena = false;
+
+// set by the `--check` flag, checks a random sample of the outputs against the long double reference after each run
+bool check_outputs = false;
+
+// set by the `--sparse-grid` flag, runs the benchmarks on batches built from a sparse grid (see `SparseGridWorkload`)
+bool use_sparse_grid = false;
+
 /*
  * runs a benchmark with the given parameters
  * `nb_distinct_outputs` modelizes the fact that most outputs are identical
+ * `kronmult_function` lets you bench a specific implementation rather than the one chosen by `kronmult_batched`
+ * with the `--sparse-grid` flag, the batch is built by `runBenchSparseGrid` instead
  */
 long runBench(int const degree, int const dimension, int const grid_level, std::string const benchName,
-              int const nb_distinct_outputs = 5)
+              KronmultFunction *kronmult_function = kronmult_batched<Number>, int const nb_distinct_outputs = 5)
 {
+    if (use_sparse_grid)
+    {
+        return runBenchSparseGrid<Number>(degree, dimension, grid_level, benchName, kronmult_function, check_outputs,
+                                          use_arena);
+    }
+
     // Kronmult parameters
     int const matrix_size  = degree;
     int const matrix_count = dimension;
@@ -27,19 +68,169 @@ long runBench(int const degree, int const dimension, int const grid_level, std::
               << " nb_distinct_outputs:" << nb_distinct_outputs << std::endl;
 
     // allocates a problem
-    // we do not put data in the vectors/matrices as it doesn't matter here
+    // we do not put data in the vectors/matrices as it doesn't matter here, unless the outputs are checked
     std::cout << "Starting allocation." << std::endl;
-    ArrayBatch<Number> matrix_list_batched(matrix_size * matrix_stride, batch_count * matrix_count);
-    ArrayBatch<Number> input_batched(size_input, batch_count);
-    ArrayBatch<Number> workspace_batched(size_input, batch_count);
-    ArrayBatch_withRepetition<Number> output_batched(size_input, batch_count, nb_distinct_outputs);
+    bool const should_initialize_data = check_outputs;
+    ArrayBatch<Number> matrix_list_batched(matrix_size * matrix_stride, batch_count * matrix_count, should_initialize_data, use_arena);
+    ArrayBatch<Number> input_batched(size_input, batch_count, should_initialize_data, use_arena);
+    ArrayBatch<Number> workspace_batched(size_input, batch_count, false, use_arena);
+    ArrayBatch_withRepetition<Number> output_batched(size_input, batch_count, nb_distinct_outputs, should_initialize_data, use_arena);
+
+    // the reference is computed before the inputs are used as workspaces (and is not timed)
+    std::unique_ptr<SampledVerification<Number>> verification;
+    if (check_outputs)
+    {
+        std::cout << "Starting sampled reference" << std::endl;
+        verification.reset(new SampledVerification<Number>(matrix_count, matrix_size, matrix_list_batched.rawPointer,
+                                                            matrix_stride, input_batched.rawPointer,
+                                                            output_batched.rawPointer, batch_count));
+    }
 
     // runs kronmult several times and displays the average runtime
     std::cout << "Starting Kronmult" << std::endl;
     auto start = std::chrono::high_resolution_clock::now();
-    kronmult_batched(matrix_count, matrix_size, matrix_list_batched.rawPointer, matrix_stride,
-                     input_batched.rawPointer, output_batched.rawPointer, workspace_batched.rawPointer,
-                     batch_count);
+    kronmult_function(matrix_count, matrix_size, matrix_list_batched.rawPointer, matrix_stride,
+                      input_batched.rawPointer, output_batched.rawPointer, workspace_batched.rawPointer,
+                      batch_count);
+    auto stop         = std::chrono::high_resolution_clock::now();
+    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+    std::cout << "Runtime: " << milliseconds << "ms" << std::endl;
+
+    if (verification)
+    {
+        Number const error = verification->error(output_batched.rawPointer);
+        std::cout << "Sampled error: " << error << std::endl;
+        if(error > 1e-7) std::cerr << "Check failed!" << std::endl;
+    }
+
+    return milliseconds;
+}
+
+/*
+ * runs a benchmark of a Kronecker sum with the given parameters
+ * times `kronmult_batched_sum` and the same sum written as `matrix_count` terms full of identities (computed with
+ * `kronmult_batched_terms`), returns both runtimes (sum first)
+ */
+std::pair<long, long> runBenchKroneckerSum(int const degree, int const dimension, int const grid_level,
+                                           std::string const benchName, int const nb_distinct_outputs = 5)
+{
+    // Kronmult parameters
+    int const matrix_size  = degree;
+    int const matrix_count = dimension;
+    int const size_input   = pow_int(matrix_size, matrix_count);
+    int const matrix_stride = 67; // large prime integer, modelize the fact that columns are not adjascent in memory
+    int const batch_count = compute_batch_size(degree, dimension, grid_level, nb_distinct_outputs);
+    std::cout << benchName << " kronecker sum benchcase"
+              << " batch_count:" << batch_count << " matrix_size:" << matrix_size
+              << " matrix_count:" << matrix_count << " size_input:" << size_input
+              << " nb_distinct_outputs:" << nb_distinct_outputs << std::endl;
+
+    // allocates a problem
+    // we do not put data in the vectors/matrices as it doesn't matter here
+    std::cout << "Starting allocation." << std::endl;
+    ArrayBatch<Number> matrix_list_batched(matrix_size * matrix_stride, batch_count * matrix_count, false, use_arena);
+    ArrayBatch<Number> input_batched(size_input, batch_count, false, use_arena);
+    ArrayBatch_withRepetition<Number> output_batched(size_input, batch_count, nb_distinct_outputs, false, use_arena);
+    std::vector<Number> identity(matrix_size * matrix_stride, 0.);
+    for(int r = 0; r < matrix_size; r++) identity[r + r * matrix_stride] = 1.;
+    std::vector<std::vector<Number const *>> matrix_lists_terms(matrix_count, std::vector<Number const *>(batch_count * matrix_count));
+    std::vector<Number const *const *> matrix_list_batched_terms;
+    for(int t = 0; t < matrix_count; t++)
+    {
+        for(int k = 0; k < batch_count * matrix_count; k++)
+        {
+            matrix_lists_terms[t][k] = (k % matrix_count == t) ? matrix_list_batched.rawPointer[k] : identity.data();
+        }
+        matrix_list_batched_terms.push_back(matrix_lists_terms[t].data());
+    }
+
+    std::cout << "Starting multi-term Kronmult" << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    kronmult_batched_terms(matrix_count, matrix_size, matrix_count, matrix_list_batched_terms.data(), matrix_stride,
+                           input_batched.rawPointer, output_batched.rawPointer, batch_count);
+    auto stop               = std::chrono::high_resolution_clock::now();
+    auto milliseconds_terms = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+    std::cout << "Runtime (terms): " << milliseconds_terms << "ms" << std::endl;
+
+    std::cout << "Starting Kronecker sum" << std::endl;
+    start = std::chrono::high_resolution_clock::now();
+    kronmult_batched_sum(matrix_count, matrix_size, matrix_list_batched.rawPointer, matrix_stride,
+                         input_batched.rawPointer, output_batched.rawPointer, batch_count);
+    stop                  = std::chrono::high_resolution_clock::now();
+    auto milliseconds_sum = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+    std::cout << "Runtime (sum): " << milliseconds_sum << "ms" << std::endl;
+
+    return {milliseconds_sum, milliseconds_terms};
+}
+
+/*
+ * runs a benchmark with the given parameters using `kronmult_batched_streaming`
+ * uses the theorical batch count, that might be too large to be allocated, and only allocates two chunks of inputs
+ * the matrices are taken cyclically from a pool the size of a chunk
+ */
+long runBenchStreaming(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                       int const chunk_size = 256, int const nb_distinct_outputs = 5)
+{
+    // Kronmult parameters
+    int const matrix_size  = degree;
+    int const matrix_count = dimension;
+    int const size_input   = pow_int(matrix_size, matrix_count);
+    int const matrix_stride = 67; // large prime integer, modelize the fact that columns are not adjascent in memory
+    int const batch_count = compute_batch_size_unbounded(degree, dimension, grid_level);
+    std::cout << benchName << " streaming benchcase"
+              << " batch_count:" << batch_count << " matrix_size:" << matrix_size
+              << " matrix_count:" << matrix_count << " size_input:" << size_input
+              << " nb_distinct_outputs:" << nb_distinct_outputs << " chunk_size:" << chunk_size << std::endl;
+
+    // allocates the resident part of the problem and the two chunks of inputs
+    std::cout << "Starting allocation." << std::endl;
+    ArrayBatch<Number> matrix_pool(matrix_size * matrix_stride, chunk_size * matrix_count, false, use_arena);
+    ArrayBatch<Number> input_slots(size_input, 2 * chunk_size, false, use_arena);
+    ArrayBatch_withRepetition<Number> output_batched(size_input, batch_count, nb_distinct_outputs, false, use_arena);
+
+    // the generator only sets pointers, a real one would also fill the inputs
+    auto generator = [&](kronmult_chunk<Number> &chunk) {
+        for(int i = 0; i < chunk.nb_batch; i++)
+        {
+            chunk.input_batched[i] = input_slots.rawPointer[chunk.slot * chunk_size + i];
+            chunk.output_batched[i] = output_batched.rawPointer[chunk.first + i];
+            for(int m = 0; m < matrix_count; m++)
+            {
+                chunk.matrix_list_batched[i * matrix_count + m] = matrix_pool.rawPointer[i * matrix_count + m];
+            }
+        }
+    };
+
+    std::cout << "Starting Kronmult" << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    kronmult_batched_streaming<Number>(matrix_count, matrix_size, matrix_stride, batch_count, chunk_size, generator);
+    auto stop         = std::chrono::high_resolution_clock::now();
+    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+    std::cout << "Runtime: " << milliseconds << "ms" << std::endl;
+
+    return milliseconds;
+}
+
+/*
+ * runs a benchmark on a problem captured with `kronmult_capture`
+ * NOTE: the inputs are modified (in memory only) by the computation, a file can thus only be replayed once per load
+ */
+long runBenchReplay(std::string const &path)
+{
+    // maps the problem
+    kronmult_problem_file<Number> problem(path);
+    std::cout << path << " replay"
+              << " batch_count:" << problem.nb_batch << " matrix_size:" << problem.matrix_size
+              << " matrix_count:" << problem.matrix_count << " size_input:" << problem.size_input
+              << " nb_distinct_matrices:" << problem.nb_matrices << " nb_distinct_inputs:" << problem.nb_inputs
+              << " nb_distinct_outputs:" << problem.nb_outputs << std::endl;
+    ArrayBatch<Number> workspace_batched(problem.size_input, problem.nb_batch, false, use_arena);
+
+    std::cout << "Starting Kronmult" << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    kronmult_batched(problem.matrix_count, problem.matrix_size, problem.matrix_list_batched.data(), problem.matrix_stride,
+                     problem.input_batched.data(), problem.output_batched.data(), workspace_batched.rawPointer,
+                     problem.nb_batch);
     auto stop         = std::chrono::high_resolution_clock::now();
     auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
     std::cout << "Runtime: " << milliseconds << "ms" << std::endl;
@@ -49,20 +240,58 @@ long runBench(int const degree, int const dimension, int const grid_level, std::
 
 /*
  * Runs benchmarks of increasing sizes and displays the results
+ * if files captured with `kronmult_capture` are given as arguments, replays them instead
+ * the `--arena` flag allocates the vectors in a `kronmult_arena`
+ * the `--check` flag checks a sample of the outputs of the generated benchmarks against a long double reference
+ * the `--sparse-grid` flag builds the benchmarks from a sparse grid rather than with random outputs
  */
-int main()
+int main(int argc, char *argv[])
 {
+    std::vector<std::string> captures;
+    for(int a = 1; a < argc; a++)
+    {
+        std::string const argument = argv[a];
+        if (argument == "--arena") use_arena = true;
+        else if (argument == "--check") check_outputs = true;
+        else if (argument == "--sparse-grid") use_sparse_grid = true;
+        else captures.push_back(argument);
+    }
+
     std::cout << "Starting benchmark (" << omp_get_num_procs() << " procs)." << std::endl;
+    std::cout << "Build: " << kronmult_build_info_string() << std::endl;
+    std::cout << "Allocation: " << (use_arena ? "arena" : "new") << std::endl;
+    if (check_outputs) std::cout << "Outputs checked against the sampled reference." << std::endl;
+    if (use_sparse_grid) std::cout << "Batches built from a sparse grid." << std::endl;
     #ifdef KRONMULT_USE_BLAS
         std::cout << "BLAS detected properly." << std::endl;
     #endif
 
+    // replays captured problems
+    if (not captures.empty())
+    {
+        std::vector<long> times;
+        for(std::string const &capture : captures) times.push_back(runBenchReplay(capture));
+        std::cout << std::endl << "Results:" << std::endl;
+        for(size_t i = 0; i < captures.size(); i++) std::cout << captures[i] << ": " << times[i] << "ms" << std::endl;
+        return 0;
+    }
+
     // running the benchmarks
     auto toy       = runBench(4, 1, 2, "toy");
     auto small     = runBench(4, 2, 4, "small");
     auto medium    = runBench(6, 3, 6, "medium");
     auto large     = runBench(8, 6, 7, "large");
     auto realistic = runBench(8, 6, 9, "realistic");
+    auto realistic_streaming = runBenchStreaming(8, 6, 9, "realistic");
+    // cost of the reproducible accumulation
+    auto medium_deterministic = runBench(6, 3, 6, "medium", kronmult_batched_deterministic<Number>);
+    auto large_deterministic = runBench(8, 6, 7, "large", kronmult_batched_deterministic<Number>);
+    // threads cooperating on each batch element, by teams of 2 and 4
+    auto large_teams2 = runBench(8, 6, 7, "large", kronmult_batched_teams_of<2>);
+    auto large_teams4 = runBench(8, 6, 7, "large", kronmult_batched_teams_of<4>);
+    // Kronecker sums, compared to the same sums written as terms
+    auto medium_sum = runBenchKroneckerSum(6, 3, 6, "medium");
+    auto large_sum = runBenchKroneckerSum(8, 6, 7, "large");
 
     // display results
     std::cout << std::endl
@@ -71,5 +300,12 @@ int main()
               << "small: " << small << "ms" << std::endl
               << "medium: " << medium << "ms" << std::endl
               << "large: " << large << "ms" << std::endl
-              << "realistic: " << realistic << "ms" << std::endl;
+              << "realistic: " << realistic << "ms" << std::endl
+              << "realistic (streaming): " << realistic_streaming << "ms" << std::endl
+              << "medium (deterministic): " << medium_deterministic << "ms" << std::endl
+              << "large (deterministic): " << large_deterministic << "ms" << std::endl
+              << "large (teams of 2): " << large_teams2 << "ms" << std::endl
+              << "large (teams of 4): " << large_teams4 << "ms" << std::endl
+              << "medium (kronecker sum): " << medium_sum.first << "ms (as terms: " << medium_sum.second << "ms)" << std::endl
+              << "large (kronecker sum): " << large_sum.first << "ms (as terms: " << large_sum.second << "ms)" << std::endl;
 }
@@ -0,0 +1,108 @@
+#include "utils/utils_cpu.h"
+#include "utils/utils_target.h"
+#include <chrono>
+#include <iostream>
+#include <kronmult.hpp>
+#include <kronmult_target.hpp>
+#include "utils/batch_size.h"
+#include <omp.h>
+#include <utility>
+
+// change this to run the bench in another precision
+using Number = double;
+
+/*
+ * runs a benchmark with the given parameters with both `kronmult_batched_target` and `kronmult_batched`
+ * (kronmult_omp, on the host) and returns their runtimes in that order
+ * `nb_distinct_outputs` modelizes the fact that most outputs are identical
+ */
+std::pair<long, long> runBench(int const degree, int const dimension, int const grid_level,
+                               std::string const benchName, int const nb_distinct_outputs = 5)
+{
+    // Kronmult parameters
+    int const matrix_size  = degree;
+    int const matrix_count = dimension;
+    int const size_input   = pow_int(matrix_size, matrix_count);
+    int const matrix_stride = 67; // large prime integer, modelize the fact that columns are not adjascent in memory
+    int const batch_count = compute_batch_size(degree, dimension, grid_level, nb_distinct_outputs);
+    std::cout << benchName << " benchcase"
+              << " batch_count:" << batch_count << " matrix_size:" << matrix_size
+              << " matrix_count:" << matrix_count << " size_input:" << size_input
+              << " nb_distinct_outputs:" << nb_distinct_outputs << std::endl;
+
+    // allocates a problem
+    // we do not put data in the vectors/matrices as it doesn't matter here
+    std::cout << "Starting allocation." << std::endl;
+    ArrayBatch<Number> matrix_list_batched(matrix_size * matrix_stride, batch_count * matrix_count);
+    ArrayBatch<Number> input_batched(size_input, batch_count);
+    ArrayBatch<Number> workspace_batched(size_input, batch_count);
+    ArrayBatch_withRepetition<Number> output_batched(size_input, batch_count, nb_distinct_outputs);
+
+    // the copy on the device is released before running on the host
+    // as, without a device, it is a second copy of the problem in host memory
+    long milliseconds_target = 0;
+    {
+        TargetArrayBatch<Number> device_matrix_list_batched(matrix_list_batched.rawPointer,
+                                                            matrix_size * matrix_stride, batch_count * matrix_count);
+        TargetArrayBatch<Number> device_input_batched(input_batched.rawPointer, size_input, batch_count);
+        TargetArrayBatch<Number> device_workspace_batched(workspace_batched.rawPointer, size_input, batch_count);
+        TargetArrayBatch<Number> device_output_batched(output_batched.rawPointer, size_input, batch_count);
+
+        std::cout << "Starting Kronmult (target)" << std::endl;
+        auto start = std::chrono::high_resolution_clock::now();
+        kronmult_batched_target<Number>(matrix_count, matrix_size, device_matrix_list_batched.rawPointer,
+                                        matrix_stride, device_input_batched.rawPointer,
+                                        device_output_batched.rawPointer, device_workspace_batched.rawPointer,
+                                        batch_count);
+        auto stop           = std::chrono::high_resolution_clock::now();
+        milliseconds_target = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+        std::cout << "Runtime (target): " << milliseconds_target << "ms" << std::endl;
+    }
+
+    std::cout << "Starting Kronmult (omp)" << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    kronmult_batched(matrix_count, matrix_size, matrix_list_batched.rawPointer, matrix_stride,
+                     input_batched.rawPointer, output_batched.rawPointer, workspace_batched.rawPointer,
+                     batch_count);
+    auto stop             = std::chrono::high_resolution_clock::now();
+    auto milliseconds_omp = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+    std::cout << "Runtime (omp): " << milliseconds_omp << "ms" << std::endl;
+
+    return {milliseconds_target, milliseconds_omp};
+}
+
+/*
+ * Runs benchmarks of increasing sizes and displays the results
+ */
+int main()
+{
+    std::cout << "Starting benchmark (" << omp_get_num_procs() << " procs)." << std::endl;
+    std::cout << "Build: " << kronmult_build_info_string() << std::endl;
+    int const nb_devices = omp_get_num_devices();
+    if (nb_devices > 0)
+    {
+        std::cout << "OpenMP device:" << omp_get_default_device() << " devicesAvailable:" << nb_devices << std::endl;
+    }
+    else
+    {
+        std::cout << "No OpenMP device, the target version runs on the host." << std::endl;
+    }
+
+    // running the benchmarks
+    auto toy       = runBench(4, 1, 2, "toy");
+    auto small     = runBench(4, 2, 4, "small");
+    auto medium    = runBench(6, 3, 6, "medium");
+    auto large     = runBench(8, 6, 7, "large");
+    auto realistic = runBench(8, 6, 9, "realistic");
+
+    // display results
+    auto display = [](std::string const &name, std::pair<long, long> const &times) {
+        std::cout << name << ": " << times.first << "ms (target) " << times.second << "ms (omp)" << std::endl;
+    };
+    std::cout << std::endl << "Results:" << std::endl;
+    display("toy", toy);
+    display("small", small);
+    display("medium", medium);
+    display("large", large);
+    display("realistic", realistic);
+}
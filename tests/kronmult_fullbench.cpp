@@ -1,13 +1,22 @@
+#include "utils/bench_sparse_grid.h"
 #include "utils/utils_cpu.h"
+#include "utils/workload.h"
 #include <chrono>
 #include <iostream>
 #include <kronmult.hpp>
 #include "utils/batch_size.h"
 #include <omp.h>
+#ifdef KRONMULT_USE_MPI
+#include <kronmult_mpi.hpp>
+#include <vector>
+#endif
 
 // change this to run the bench in another precision
 using Number = double;
 
+// set by the `--sparse-grid` flag, runs the benchmarks on batches built from a sparse grid (see `SparseGridWorkload`)
+bool use_sparse_grid = false;
+
 /*
  * runs a benchmark with the given parameters
  * `nb_distinct_outputs` modelizes the fact that most outputs are identical
@@ -47,12 +56,163 @@ long runBench(int const degree, int const dimension, int const grid_level, std::
     return milliseconds;
 }
 
+#ifdef KRONMULT_USE_MPI
+// number of applications timed per configuration
+int const nb_distributed_repetitions = 5;
+
+/*
+ * runs a distributed benchmark with the given parameters on the ranks of `comm`
+ * returns the average runtime of an application in milliseconds (the maximum over the ranks)
+ * and stores the number of batch elements in `batch_count`
+ */
+double runBenchDistributed(MPI_Comm const comm, int const degree, int const dimension, int const grid_level,
+                           int &batch_count)
+{
+    // sparse grid problem, built identically on all ranks
+    SparseGrid const grid = make_sparse_grid(dimension, grid_level);
+    std::vector<int> connectivity_starts, connectivity;
+    make_sparse_grid_connectivity(grid, connectivity_starts, connectivity);
+    int const nb_elements = grid.nb_elements();
+    kronmult_sparse_grid_batch const batch =
+        kronmult_build_sparse_grid_batch(dimension, nb_elements, grid.levels.data(), grid.cells.data(),
+                                         connectivity_starts.data(), connectivity.data());
+    batch_count = batch.nb_batch();
+
+    // Kronmult parameters
+    int const matrix_size     = degree;
+    int const matrix_count    = dimension;
+    int const size_input      = pow_int(matrix_size, matrix_count);
+    int const operator_size   = matrix_size * pow_int(2, grid_level);
+    int const operator_stride = operator_size;
+
+    // allocates the local part of the problem
+    std::default_random_engine rng(42);
+    std::vector<std::vector<Number>> operators(matrix_count, std::vector<Number>(operator_size * operator_stride));
+    std::vector<Number const *> operator_pointers;
+    for(auto &op : operators)
+    {
+        fillArray(op.data(), op.size(), rng);
+        operator_pointers.push_back(op.data());
+    }
+    kronmult_distributed<Number> distributed(comm, batch, matrix_size);
+    size_t const nb_local = static_cast<size_t>(distributed.nb_local_elements()) * size_input;
+    std::vector<Number> input(nb_local), output(nb_local);
+    fillArray(input.data(), input.size(), rng);
+    fillArray(output.data(), output.size(), rng);
+
+    // times the applications
+    distributed.apply(operator_pointers.data(), operator_stride, input.data(), output.data());
+    MPI_Barrier(comm);
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int r = 0; r < nb_distributed_repetitions; r++)
+    {
+        distributed.apply(operator_pointers.data(), operator_stride, input.data(), output.data());
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    double const local_time =
+        std::chrono::duration<double, std::milli>(stop - start).count() / nb_distributed_repetitions;
+    double time;
+    MPI_Allreduce(&local_time, &time, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return time;
+}
+
+/*
+ * Runs strong and weak scaling benchmarks on 1, 2, 4... ranks (up to the size of MPI_COMM_WORLD)
+ * strong scaling keeps the grid level fixed, weak scaling increases it with the number of ranks
+ */
+void runDistributedBenchmarks()
+{
+    int rank, nb_ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nb_ranks);
+    if(rank == 0)
+    {
+        std::cout << "Starting distributed benchmark (" << nb_ranks << " ranks)." << std::endl;
+        std::cout << "Build: " << kronmult_build_info_string() << std::endl;
+    }
+
+    int const degree = 4;
+    int const dimension = 3;
+    int const grid_level = 5;
+    std::vector<int> rank_counts;
+    for(int p = 1; p <= nb_ranks; p *= 2) rank_counts.push_back(p);
+
+    // runs all configurations, ranks that are not part of a sub-communicator wait for the others
+    std::vector<double> strong_times, weak_times;
+    std::vector<int> strong_batch_counts, weak_batch_counts;
+    int weak_level = grid_level;
+    for(int const p : rank_counts)
+    {
+        MPI_Comm comm;
+        MPI_Comm_split(MPI_COMM_WORLD, (rank < p) ? 0 : MPI_UNDEFINED, rank, &comm);
+        double strong_time = 0.;
+        double weak_time = 0.;
+        int strong_batch_count = 0;
+        int weak_batch_count = 0;
+        if(comm != MPI_COMM_NULL)
+        {
+            strong_time = runBenchDistributed(comm, degree, dimension, grid_level, strong_batch_count);
+            weak_time = runBenchDistributed(comm, degree, dimension, weak_level, weak_batch_count);
+            MPI_Comm_free(&comm);
+        }
+        strong_times.push_back(strong_time);
+        weak_times.push_back(weak_time);
+        strong_batch_counts.push_back(strong_batch_count);
+        weak_batch_counts.push_back(weak_batch_count);
+        // a sparse grid has a bit more than twice as many elements at the next level
+        weak_level++;
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    // display results
+    if(rank == 0)
+    {
+        std::cout << std::endl << "Strong scaling (degree:" << degree << " dimension:" << dimension
+                  << " level:" << grid_level << "):" << std::endl;
+        for(size_t i = 0; i < rank_counts.size(); i++)
+        {
+            double const speedup = strong_times[0] / strong_times[i];
+            std::cout << "ranks:" << rank_counts[i] << " batch_count:" << strong_batch_counts[i]
+                      << " runtime:" << strong_times[i] << "ms speedup:" << speedup
+                      << " efficiency:" << speedup / rank_counts[i] << std::endl;
+        }
+        std::cout << std::endl << "Weak scaling (degree:" << degree << " dimension:" << dimension
+                  << " level:" << grid_level << "+log2(ranks)):" << std::endl;
+        for(size_t i = 0; i < rank_counts.size(); i++)
+        {
+            // the work does not grow exactly linearly with the level, the efficiency is thus computed per batch element
+            double const batch_per_rank = static_cast<double>(weak_batch_counts[i]) / rank_counts[i];
+            double const efficiency = (weak_times[0] / weak_batch_counts[0]) / (weak_times[i] / batch_per_rank);
+            std::cout << "ranks:" << rank_counts[i] << " level:" << grid_level + static_cast<int>(i)
+                      << " batch_count:" << weak_batch_counts[i] << " runtime:" << weak_times[i]
+                      << "ms efficiency:" << efficiency << std::endl;
+        }
+    }
+}
+#endif
+
 /*
  * Runs benchmarks of increasing sizes and displays the results
+ * the `--sparse-grid` flag builds the benchmarks from a sparse grid rather than with random outputs
+ * when built with `KRONMULT_USE_MPI`, runs the distributed scaling benchmarks instead
  */
-int main()
+int main(int argc, char *argv[])
 {
+    #ifdef KRONMULT_USE_MPI
+        MPI_Init(&argc, &argv);
+        runDistributedBenchmarks();
+        MPI_Finalize();
+        return 0;
+    #endif
+
+    for(int a = 1; a < argc; a++)
+    {
+        if (std::string(argv[a]) == "--sparse-grid") use_sparse_grid = true;
+    }
+
     std::cout << "Starting benchmark (" << omp_get_num_procs() << " procs)." << std::endl;
+    std::cout << "Build: " << kronmult_build_info_string() << std::endl;
+    if (use_sparse_grid) std::cout << "Batches built from a sparse grid." << std::endl;
     #ifdef KRONMULT_USE_BLAS
         std::cout << "BLAS detected properly." << std::endl;
     #endif
@@ -71,7 +231,9 @@ int main()
                 int const batch_count = compute_batch_size(degree, dimension, level, nb_distinct_outputs);
                 std::string name = "degree:" + std::to_string(degree) + " dimension:" + std::to_string(dimension)
                                  + " level:" + std::to_string(level) + " batch-size:" + std::to_string(batch_count);
-                auto time = runBench(degree, dimension, level, name, nb_distinct_outputs);
+                auto time = use_sparse_grid
+                                ? runBenchSparseGrid<Number>(degree, dimension, level, name, kronmult_batched<Number>)
+                                : runBench(degree, dimension, level, name, nb_distinct_outputs);
                 // strore result
                 names.push_back(name);
                 times.push_back(time);
@@ -0,0 +1,95 @@
+#include "utils/utils_cpu.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <kronmult.hpp>
+#include <omp.h>
+
+// change this to run the bench in another precision
+using Number = double;
+
+// number of runs per configuration, we keep the minimum as noise is additive
+int const nb_repetitions = 200;
+
+/*
+ * returns the minimum runtime, in microseconds, of `kronmult_batched_serial` and `kronmult_batched_parallel`
+ * on a batch with the given parameters
+ */
+std::pair<double, double> runLatencyBench(int const matrix_size, int const matrix_count, int const batch_count,
+                                          int const nb_distinct_outputs = 5)
+{
+    // Kronmult parameters
+    int const size_input    = pow_int(matrix_size, matrix_count);
+    int const matrix_stride = matrix_size;
+
+    // allocates a problem
+    // the data is initialized to avoid slow denormalized numbers
+    bool const should_initialize_data = true;
+    ArrayBatch<Number> matrix_list_batched(matrix_size * matrix_stride, batch_count * matrix_count, should_initialize_data);
+    ArrayBatch<Number> input_batched(size_input, batch_count, should_initialize_data);
+    ArrayBatch<Number> input_batched_pristine(size_input, batch_count); // kronmult uses the inputs as workspaces
+    for(int i = 0; i < batch_count; i++) std::copy_n(input_batched.rawPointer[i], size_input, input_batched_pristine.rawPointer[i]);
+    ArrayBatch<Number> workspace_batched(size_input, batch_count, should_initialize_data);
+    ArrayBatch_withRepetition<Number> output_batched(size_input, batch_count, std::min(batch_count, nb_distinct_outputs),
+                                                     should_initialize_data);
+
+    // times a given implementation
+    auto time = [&](auto kronmult_implementation) {
+        double best = 1e300;
+        for(int r = 0; r < nb_repetitions; r++)
+        {
+            // restores the inputs, outside of the timed region
+            for(int i = 0; i < batch_count; i++) std::copy_n(input_batched_pristine.rawPointer[i], size_input, input_batched.rawPointer[i]);
+            auto start = std::chrono::high_resolution_clock::now();
+            kronmult_implementation(matrix_count, matrix_size, matrix_list_batched.rawPointer, matrix_stride,
+                                    input_batched.rawPointer, output_batched.rawPointer,
+                                    workspace_batched.rawPointer, batch_count);
+            auto stop = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::micro>(stop - start).count());
+        }
+        return best;
+    };
+    double const serial   = time(kronmult_batched_serial<Number>);
+    double const parallel = time(kronmult_batched_parallel<Number>);
+    return {serial, parallel};
+}
+
+/*
+ * Runs small batches of increasing amount of work with both the serial and the parallel implementations
+ * and displays the amount of work from which the parallel implementation becomes faster
+ * this is used to choose `KRONMULT_SERIAL_THRESHOLD`
+ */
+int main()
+{
+    std::cout << "Starting latency benchmark (" << omp_get_max_threads() << " threads)." << std::endl;
+    std::cout << "Build: " << kronmult_build_info_string() << std::endl;
+    std::cout << "Current threshold: " << KRONMULT_SERIAL_THRESHOLD << std::endl;
+
+    // warms the OpenMP team up such that its creation is not counted
+    #pragma omp parallel
+    {
+    }
+
+    // smallest amount of work for which the parallel version is faster
+    long long crossover = -1;
+    for(int matrix_count = 1; matrix_count <= 3; matrix_count++)
+    {
+        for(int matrix_size = 2; matrix_size <= 8; matrix_size *= 2)
+        {
+            for(int batch_count = 1; batch_count <= 1024; batch_count *= 4)
+            {
+                int const size_input = pow_int(matrix_size, matrix_count);
+                long long const work = static_cast<long long>(batch_count) * size_input * matrix_size * matrix_count;
+                auto const times = runLatencyBench(matrix_size, matrix_count, batch_count);
+                std::cout << "matrix_size:" << matrix_size << " matrix_count:" << matrix_count
+                          << " batch_count:" << batch_count << " work:" << work
+                          << " serial:" << times.first << "us parallel:" << times.second << "us" << std::endl;
+                if ((times.second < times.first) and ((crossover < 0) or (work < crossover))) crossover = work;
+            }
+        }
+    }
+
+    std::cout << std::endl;
+    if (crossover < 0) std::cout << "The serial version was always faster." << std::endl;
+    else std::cout << "The parallel version starts being faster at work:" << crossover << std::endl;
+}
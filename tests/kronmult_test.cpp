@@ -1,63 +1,1059 @@
 #include "utils/kronmult_naive.h"
+#include "utils/kronmult_reference.h"
 #include "utils/utils_cpu.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
 #include <kronmult.hpp>
+#include <kronmult_async.hpp>
+#include <kronmult_capture.hpp>
+#include <kronmult_explicit.hpp>
+#include <kronmult_krylov.hpp>
+#include <kronmult_sparse_grid.hpp>
+#include <kronmult_streaming.hpp>
+#include <kronmult_sum.hpp>
+#include <kronmult_terms.hpp>
+#include <kronmult_time_stepping.hpp>
+#include <kronmult_zeros.hpp>
 #include "utils/batch_size.h"
+#include "utils/sparse_grid.h"
+#include "utils/workload.h"
 #include <omp.h>
 
 // change this to run the bench in another precision
 using Number = double;
 
+// signature shared by `kronmult_batched` and the implementations it dispatches to
+using KronmultFunction = void(int const, int const, Number const *const[], int const, Number *[], Number *[],
+                              Number *[], int const);
+
+/*
+ * batched problem shared by the tests, filled with random data
+ * `nb_terms` batches of matrices and inputs (modelizing PDE terms) write into the same outputs
+ * `compute_reference` adds their naive products to `output_expected` while the tested kernel writes into `output`,
+ * both start with the same values
+ * a test can edit the data and the pointer arrays before the reference is computed to build a specific pattern
+ */
+struct BatchedProblem
+{
+    // Kronmult parameters
+    int const matrix_size;
+    int const matrix_count;
+    int const size_input;
+    int const matrix_stride = 67; // large prime integer, modelize the fact that columns are not adjascent in memory
+    int const nb_distinct_outputs;
+    int const batch_count;
+    int const nb_terms;
+    // data of each term, the inputs are only read by the reference, the kernel works on copies
+    std::vector<std::unique_ptr<ArrayBatch<Number>>> matrices, inputs, input_copies, workspaces;
+    ArrayBatch_withRepetition<Number> output_expected;
+    ArrayBatch_withRepetition<Number> output;
+    // pointer arrays, the outputs of `output_expected` and `output` are listed in the same order
+    std::vector<std::vector<Number *>> matrix_lists;
+    std::vector<Number *> output_list_expected, output_list;
+
+    BatchedProblem(int const degree, int const dimension, int const grid_level, std::string const caseName,
+                   int const nb_distinct_outputs = 5, int const nb_terms = 1, bool const use_arena = false,
+                   int const max_batch_count = std::numeric_limits<int>::max())
+        : matrix_size(degree), matrix_count(dimension), size_input(pow_int(matrix_size, matrix_count)),
+          nb_distinct_outputs(nb_distinct_outputs),
+          batch_count(std::min(max_batch_count, compute_batch_size(degree, dimension, grid_level, nb_distinct_outputs))),
+          nb_terms(nb_terms), output_expected(size_input, batch_count, nb_distinct_outputs, true, use_arena),
+          output(output_expected)
+    {
+        std::cout << caseName << " benchcase"
+                  << " batch_count:" << batch_count << " matrix_size:" << matrix_size
+                  << " matrix_count:" << matrix_count << " size_input:" << size_input
+                  << " nb_distinct_outputs:" << nb_distinct_outputs << " nb_terms:" << nb_terms << std::endl;
+
+        bool const should_initialize_data = true;
+        for(int t = 0; t < nb_terms; t++)
+        {
+            matrices.emplace_back(new ArrayBatch<Number>(matrix_size * matrix_stride, batch_count * matrix_count, should_initialize_data, use_arena));
+            inputs.emplace_back(new ArrayBatch<Number>(size_input, batch_count, should_initialize_data, use_arena));
+            input_copies.emplace_back(new ArrayBatch<Number>(size_input, batch_count, false, use_arena));
+            workspaces.emplace_back(new ArrayBatch<Number>(size_input, batch_count, false, use_arena));
+            matrix_lists.emplace_back(matrices[t]->rawPointer, matrices[t]->rawPointer + batch_count * matrix_count);
+        }
+        output_list_expected.assign(output_expected.rawPointer, output_expected.rawPointer + batch_count);
+        output_list.assign(output.rawPointer, output.rawPointer + batch_count);
+        restore_inputs();
+    }
+
+    // pointer arrays of the term `t`, as given to the tested kernel
+    Number **matrix_list_batched(int const t = 0) { return matrix_lists[t].data(); }
+    Number **input_batched(int const t = 0) { return input_copies[t]->rawPointer; }
+    Number **workspace_batched(int const t = 0) { return workspaces[t]->rawPointer; }
+    Number **output_batched() { return output_list.data(); }
+
+    // gives all the terms the inputs of the first term
+    void share_inputs()
+    {
+        for(int t = 1; t < nb_terms; t++)
+        {
+            for(int i = 0; i < batch_count; i++) std::copy_n(inputs[0]->rawPointer[i], size_input, inputs[t]->rawPointer[i]);
+        }
+        restore_inputs();
+    }
+
+    // kronmult uses its inputs as workspaces, they are restored from the original ones before each run
+    void restore_inputs()
+    {
+        for(int t = 0; t < nb_terms; t++)
+        {
+            for(int i = 0; i < batch_count; i++) std::copy_n(inputs[t]->rawPointer[i], size_input, input_copies[t]->rawPointer[i]);
+        }
+    }
+
+    // adds the products of all the terms to `output_expected` with the naive implementation
+    void compute_reference()
+    {
+        for(int t = 0; t < nb_terms; t++)
+        {
+            kronmult_batched_naive(matrix_count, matrix_size, matrix_lists[t].data(), matrix_stride,
+                                   inputs[t]->rawPointer, output_list_expected.data(), workspaces[t]->rawPointer,
+                                   batch_count);
+        }
+    }
+};
+
+/*
+ * displays the error of a test and whether it failed
+ * returns the error, or 1 if one of the checks specific to the test failed
+ */
+Number check_error(Number const error, bool const is_correct = true)
+{
+    std::cout << "Error: " << error << std::endl;
+    if((error > 1e-7) or (not is_correct)) std::cerr << "Test failed!" << std::endl;
+    return is_correct ? error : Number{1};
+}
+
+/*
+ * computes the naive reference of `problem` then runs `kernel`, a callable taking the problem which should add the
+ * same products to `problem.output`, and compares both
+ * `kernel` returns false if one of the checks specific to the test failed
+ * returns the error, or 1 if such a check failed
+ */
+template<typename Kernel>
+Number runTestKernel(BatchedProblem &problem, std::string const kernelName, Kernel kernel)
+{
+    std::cout << "Starting Naive Kronmult" << std::endl;
+    problem.compute_reference();
+
+    std::cout << "Starting " << kernelName << std::endl;
+    problem.restore_inputs();
+    bool const is_correct = kernel(problem);
+
+    std::cout << "Computing error" << std::endl;
+    return check_error(problem.output_expected.distance(problem.output), is_correct);
+}
+
 /*
  * runs a test with the given parameters
  * `nb_distinct_outputs` modelizes the fact that most outputs are identical
+ * `kronmult_function` lets you test a specific implementation rather than the one chosen by `kronmult_batched`
  */
 Number runTest(int const degree, int const dimension, int const grid_level, std::string const benchName,
-               int const nb_distinct_outputs = 5)
+               KronmultFunction *kronmult_function = kronmult_batched<Number>, int const nb_distinct_outputs = 5)
 {
-    // Kronmult parameters
-    int const matrix_size  = degree;
-    int const matrix_count = dimension;
-    int const size_input   = pow_int(matrix_size, matrix_count);
-    int const matrix_stride = 67; // large prime integer, modelize the fact that columns are not adjascent in memory
-    int const batch_count = compute_batch_size(degree, dimension, grid_level, nb_distinct_outputs);
-    std::cout << benchName << " benchcase"
-              << " batch_count:" << batch_count << " matrix_size:" << matrix_size
-              << " matrix_count:" << matrix_count << " size_input:" << size_input
-              << " nb_distinct_outputs:" << nb_distinct_outputs << std::endl;
+    BatchedProblem problem(degree, dimension, grid_level, benchName, nb_distinct_outputs);
+    return runTestKernel(problem, "Kronmult", [&](BatchedProblem &p) {
+        kronmult_function(p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride, p.input_batched(),
+                          p.output_batched(), p.workspace_batched(), p.batch_count);
+        return true;
+    });
+}
+
+/*
+ * runs a test with the given parameters, checking a random sample of the output entries against the long double
+ * reference rather than comparing with the naive implementation, which makes it usable at any size
+ * the batch count is capped at `max_batch_count` to keep the memory and runtime of the test bounded
+ * for problems small enough, the naive implementation is also checked against the sampled reference
+ */
+Number runTestSampled(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                      int const max_batch_count, KronmultFunction *kronmult_function = kronmult_batched<Number>,
+                      int const nb_distinct_outputs = 5, int const nb_samples = 16)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " sampled", nb_distinct_outputs, 1, false,
+                           max_batch_count);
+    std::cout << "nb_samples:" << nb_samples << std::endl;
+
+    std::cout << "Starting sampled reference" << std::endl;
+    SampledVerification<Number> verification(problem.matrix_count, problem.matrix_size, problem.matrix_list_batched(),
+                                             problem.matrix_stride, problem.input_batched(), problem.output_batched(),
+                                             problem.batch_count, nb_samples);
+
+    // checks the naive implementation against the reference
+    Number naive_error = 0.;
+    bool const is_naive_affordable = problem.size_input <= 1024;
+    if (is_naive_affordable)
+    {
+        std::cout << "Starting Naive Kronmult" << std::endl;
+        problem.compute_reference();
+        naive_error = verification.error(problem.output_list_expected.data());
+        std::cout << "Naive error: " << naive_error << std::endl;
+    }
+
+    std::cout << "Starting Kronmult" << std::endl;
+    kronmult_function(problem.matrix_count, problem.matrix_size, problem.matrix_list_batched(), problem.matrix_stride,
+                      problem.input_batched(), problem.output_batched(), problem.workspace_batched(),
+                      problem.batch_count);
+
+    std::cout << "Computing error" << std::endl;
+    return check_error(std::max(naive_error, verification.error(problem.output_batched())));
+}
+
+/*
+ * runs a test of `kronmult_batched` on a batch built by `SparseGridWorkload`, checked against the sampled reference
+ * also checks that the whole connectivity is used when the batch is not capped
+ * returns the error, or 1 if the batch is incomplete
+ */
+Number runTestWorkload(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                       int const max_batch_count)
+{
+    std::cout << benchName << " sparse grid workload benchcase"
+              << " degree:" << degree << " dimension:" << dimension << " grid_level:" << grid_level
+              << " max_batch_count:" << max_batch_count << std::endl;
 
     std::cout << "Starting allocation." << std::endl;
     bool const should_initialize_data = true;
-    ArrayBatch<Number> matrix_list_batched(matrix_size * matrix_stride, batch_count * matrix_count, should_initialize_data);
-    ArrayBatch<Number> input_batched(size_input, batch_count, should_initialize_data); // this will only be modified by the second algorithm
-    ArrayBatch<Number> workspace_batched(size_input, batch_count, should_initialize_data);
-    ArrayBatch_withRepetition<Number> output_batched(size_input, batch_count, nb_distinct_outputs, should_initialize_data);
-    ArrayBatch_withRepetition<Number> output_batched2(output_batched); // copy as this will be modified by both algorithms
+    SparseGridWorkload<Number> workload(degree, dimension, grid_level, max_batch_count, should_initialize_data);
+    workload.print_statistics(std::cout);
 
-    std::cout << "Starting Naive Kronmult" << std::endl;
-    kronmult_batched_naive(matrix_count, matrix_size, matrix_list_batched.rawPointer, matrix_stride,
-                           input_batched.rawPointer, output_batched.rawPointer, workspace_batched.rawPointer,
-                           batch_count);
+    // the batch contains every pair of connected elements, unless it was capped
+    std::vector<int> connectivity_starts;
+    std::vector<int> connectivity;
+    make_sparse_grid_connectivity(make_sparse_grid(dimension, grid_level), connectivity_starts, connectivity);
+    int const nb_connections = static_cast<int>(connectivity.size());
+    if (workload.batch_count != std::min(max_batch_count, nb_connections))
+    {
+        std::cerr << "Test failed! The batch has " << workload.batch_count << " elements." << std::endl;
+        return 1.;
+    }
+
+    std::cout << "Starting sampled reference" << std::endl;
+    SampledVerification<Number> verification(workload.matrix_count, workload.matrix_size,
+                                             workload.matrix_list_batched.data(), workload.matrix_stride,
+                                             workload.input_batched.data(), workload.output_batched.data(),
+                                             workload.batch_count);
 
     std::cout << "Starting Kronmult" << std::endl;
-    kronmult_batched(matrix_count, matrix_size, matrix_list_batched.rawPointer, matrix_stride,
-                     input_batched.rawPointer, output_batched2.rawPointer, workspace_batched.rawPointer,
-                     batch_count);
+    kronmult_batched(workload.matrix_count, workload.matrix_size, workload.matrix_list_batched.data(),
+                     workload.matrix_stride, workload.input_batched.data(), workload.output_batched.data(),
+                     workload.workspace_batched.data(), workload.batch_count);
 
     std::cout << "Computing error" << std::endl;
-    Number const error = output_batched.distance(output_batched2);
-    std::cout << "Error: " << error << std::endl;
-    if(error > 1e-7) std::cerr << "Test failed!" << std::endl;
+    return check_error(verification.error(workload.output_batched.data()));
+}
+
+/*
+ * runs a test of `kronmult_batched` on vectors allocated in a `kronmult_arena`
+ * also checks that the arrays are aligned and that a reset arena reuses its memory
+ * returns the error, or 1 if one of the checks failed
+ */
+Number runTestArena(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                    int const nb_distinct_outputs = 5)
+{
+    bool const use_arena = true;
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " arena", nb_distinct_outputs, 1, use_arena);
+
+    // all arrays should be aligned
+    auto is_aligned = [](Number const *const pointer) {
+        return reinterpret_cast<std::uintptr_t>(pointer) % KRONMULT_ALIGNMENT == 0;
+    };
+    bool is_correct = true;
+    for(int i = 0; i < problem.batch_count * problem.matrix_count; i++) is_correct = is_correct and is_aligned(problem.matrix_list_batched()[i]);
+    for(int i = 0; i < problem.batch_count; i++)
+    {
+        is_correct = is_correct and is_aligned(problem.input_batched()[i]) and is_aligned(problem.workspace_batched()[i])
+                     and is_aligned(problem.output_batched()[i]);
+    }
+
+    // a reset arena should hand out the same memory, without growing, including for arrays larger than a block
+    kronmult_arena arena(KRONMULT_HUGE_PAGE_SIZE);
+    Number *const small_array = arena.allocate<Number>(3);
+    Number *const large_array = arena.allocate<Number>(KRONMULT_HUGE_PAGE_SIZE);
+    std::size_t const capacity = arena.capacity();
+    arena.reset();
+    is_correct = is_correct and (arena.allocate<Number>(3) == small_array)
+                 and (arena.allocate<Number>(KRONMULT_HUGE_PAGE_SIZE) == large_array) and (arena.capacity() == capacity)
+                 and is_aligned(small_array) and is_aligned(large_array);
+    std::cout << "Aligned and reused: " << (is_correct ? "yes" : "no") << std::endl;
+
+    return runTestKernel(problem, "Kronmult", [&](BatchedProblem &p) {
+        kronmult_batched(p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride, p.input_batched(),
+                         p.output_batched(), p.workspace_batched(), p.batch_count);
+        return is_correct;
+    });
+}
+
+/*
+ * runs a test of `kronmult_batched_deterministic` with the given parameters
+ * the batch elements sharing an output are interleaved, the outputs obtained with 1 to 4 threads are compared
+ * bitwise with the ones of `kronmult_batched_serial` which are compared with the naive version
+ * returns the error, or 1 if the outputs are not bitwise identical
+ */
+Number runTestDeterministic(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                            int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " deterministic", nb_distinct_outputs);
+
+    // shuffles the outputs such that the batch elements sharing an output are not consecutive
+    std::vector<int> permutation(problem.batch_count);
+    std::iota(permutation.begin(), permutation.end(), 0);
+    std::shuffle(permutation.begin(), permutation.end(), std::default_random_engine(42));
+    auto permute = [&](ArrayBatch_withRepetition<Number> const &outputs) {
+        std::vector<Number *> permuted(problem.batch_count);
+        for(int i = 0; i < problem.batch_count; i++) permuted[i] = outputs.rawPointer[permutation[i]];
+        return permuted;
+    };
+    problem.output_list_expected = permute(problem.output_expected);
+    problem.output_list = permute(problem.output);
+
+    int nb_mismatches = 0;
+    Number const error = runTestKernel(problem, "serial Kronmult", [&](BatchedProblem &p) {
+        ArrayBatch_withRepetition<Number> const output_initial(p.output);
+        kronmult_batched_serial<Number>(p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride,
+                                        p.input_batched(), p.output_batched(), p.workspace_batched(), p.batch_count);
+
+        std::cout << "Starting deterministic Kronmult" << std::endl;
+        ArrayBatch_withRepetition<Number> output_deterministic(output_initial);
+        int const max_threads = omp_get_max_threads();
+        for(int nb_threads = 1; nb_threads <= 4; nb_threads++)
+        {
+            omp_set_num_threads(nb_threads);
+            p.restore_inputs();
+            for(size_t o = 0; o < output_initial.nb_arrays_distinct; o++)
+            {
+                std::copy_n(output_initial.rawPointer[o], p.size_input, output_deterministic.rawPointer[o]);
+            }
+            kronmult_batched_deterministic<Number>(p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride,
+                                                   p.input_batched(), permute(output_deterministic).data(),
+                                                   p.workspace_batched(), p.batch_count);
+            for(size_t o = 0; o < output_initial.nb_arrays_distinct; o++)
+            {
+                for(int j = 0; j < p.size_input; j++)
+                {
+                    if(output_deterministic.rawPointer[o][j] != p.output.rawPointer[o][j]) nb_mismatches++;
+                }
+            }
+        }
+        omp_set_num_threads(max_threads);
+        return nb_mismatches == 0;
+    });
+    std::cout << "Bitwise mismatches: " << nb_mismatches << std::endl;
+    return error;
+}
+
+/*
+ * runs a test of `kronmult_batched_skip_zeros` with the given parameters
+ * one input out of 4 is zero, one batch element out of 7 has a zero matrix and one input out of 3 has zero slices
+ * returns the error, or 1 if the plan did not find the expected number of zeros
+ */
+Number runTestZeros(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                    int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " zeros", nb_distinct_outputs);
+    int const matrix_size = problem.matrix_size;
+    int const matrix_count = problem.matrix_count;
+    int const size_input = problem.size_input;
+    int const size_slice = size_input / matrix_size;
+
+    // introduces zeros and counts the ones that should be found
+    int expected_skipped_elements = 0;
+    long long expected_skipped_slices = 0;
+    for(int i = 0; i < problem.batch_count; i++)
+    {
+        Number *const input = problem.inputs[0]->rawPointer[i];
+        bool const is_zero_input = (i % 4 == 0);
+        bool const has_zero_matrix = (i % 7 == 0);
+        bool const has_zero_slices = (i % 3 == 0) and (matrix_size > 3);
+        if(is_zero_input) std::fill_n(input, size_input, Number{0});
+        if(has_zero_matrix) std::fill_n(problem.matrix_list_batched()[i * matrix_count + (1 % matrix_count)], matrix_size * problem.matrix_stride, Number{0});
+        if(has_zero_slices)
+        {
+            std::fill_n(&input[1 * size_slice], size_slice, Number{0});
+            std::fill_n(&input[3 * size_slice], size_slice, Number{0});
+        }
+        if(is_zero_input or has_zero_matrix) expected_skipped_elements++;
+        else if(has_zero_slices) expected_skipped_slices += 2;
+    }
+
+    return runTestKernel(problem, "zero-skipping Kronmult", [&](BatchedProblem &p) {
+        kronmult_zero_plan const plan(p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride,
+                                      p.input_batched(), p.batch_count);
+        std::cout << "Zero inputs: " << plan.nb_zero_inputs() << " zero matrices: " << plan.nb_zero_matrices()
+                  << " skipped elements: " << plan.nb_skipped_elements() << " skipped slices: " << plan.nb_skipped_slices()
+                  << " skip rate: " << plan.skip_rate() << std::endl;
+        kronmult_batched_skip_zeros(p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride,
+                                    p.input_batched(), p.output_batched(), p.workspace_batched(), p.batch_count, plan);
+        return (plan.nb_skipped_elements() == expected_skipped_elements)
+               and (plan.nb_skipped_slices() == expected_skipped_slices);
+    });
+}
+
+/*
+ * runs a test of `kronmult_batched_async` with the given parameters
+ * submits `nb_terms` independent batches (modelizing PDE terms) that write into the same outputs and waits for
+ * all of them
+ */
+Number runTestAsync(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                    int const nb_terms = 3, int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " async", nb_distinct_outputs, nb_terms);
+    return runTestKernel(problem, "asynchronous Kronmult", [&](BatchedProblem &p) {
+        std::vector<kronmult_handle> handles;
+        for(int t = 0; t < p.nb_terms; t++)
+        {
+            handles.push_back(kronmult_batched_async(p.matrix_count, p.matrix_size, p.matrix_list_batched(t), p.matrix_stride,
+                                                     p.input_batched(t), p.output_batched(), p.workspace_batched(t),
+                                                     p.batch_count));
+        }
+        kronmult_wait_all(handles);
+        return true;
+    });
+}
+
+/*
+ * runs a test of `kronmult_batched_terms` with the given parameters
+ * all `nb_terms` terms share the same inputs and outputs but have their own matrices
+ */
+Number runTestTerms(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                    int const nb_terms = 3, int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " multi-term", nb_distinct_outputs, nb_terms);
+    problem.share_inputs();
+    return runTestKernel(problem, "multi-term Kronmult", [&](BatchedProblem &p) {
+        std::vector<Number const *const *> matrix_list_batched_terms;
+        for(int t = 0; t < p.nb_terms; t++) matrix_list_batched_terms.push_back(p.matrix_list_batched(t));
+        kronmult_batched_terms(p.matrix_count, p.matrix_size, p.nb_terms, matrix_list_batched_terms.data(), p.matrix_stride,
+                               p.input_batched(), p.output_batched(), p.batch_count);
+        return true;
+    });
+}
+
+/*
+ * runs a test of `kronmult_batched_sum` with the given parameters
+ * the reference is the same Kronecker sum written as `matrix_count` terms in which all the matrices but one are
+ * identities
+ * the matrices of a few batch elements are null, which removes their mode from the sum
+ */
+Number runTestKroneckerSum(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                           int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " kronecker sum", nb_distinct_outputs, dimension);
+    problem.share_inputs();
+    int const matrix_size = problem.matrix_size;
+    int const matrix_count = problem.matrix_count;
+    int const matrix_stride = problem.matrix_stride;
+    std::vector<Number> identity(matrix_size * matrix_stride, 0.);
+    std::vector<Number> zero(matrix_size * matrix_stride, 0.);
+    for(int r = 0; r < matrix_size; r++) identity[r + r * matrix_stride] = 1.;
+
+    // one term per mode, a null matrix being a zero matrix in the terms
+    std::vector<Number *> const matrix_list_sum_terms(problem.matrix_lists[0]);
+    std::vector<Number const *> matrix_list_sum(matrix_list_sum_terms.begin(), matrix_list_sum_terms.end());
+    for(int i = 0; i < problem.batch_count; i++)
+    {
+        if(i % 5 == 0) matrix_list_sum[i * matrix_count + (matrix_count - 1)] = nullptr;
+        for(int t = 0; t < matrix_count; t++)
+        {
+            for(int m = 0; m < matrix_count; m++)
+            {
+                Number *const matrix = (matrix_list_sum[i * matrix_count + m] == nullptr) ? zero.data() : matrix_list_sum_terms[i * matrix_count + m];
+                problem.matrix_lists[t][i * matrix_count + m] = (m != t) ? identity.data() : matrix;
+            }
+        }
+    }
+
+    return runTestKernel(problem, "Kronecker sum", [&](BatchedProblem &p) {
+        kronmult_batched_sum(p.matrix_count, p.matrix_size, matrix_list_sum.data(), p.matrix_stride, p.input_batched(),
+                             p.output_batched(), p.batch_count);
+        return true;
+    });
+}
+
+/*
+ * runs a test of `kronmult_batched_explicit` with the given parameters
+ * the batch elements share `nb_tuples` tuples of matrices and the batch is applied twice, the second call reusing
+ * the explicit products stored in the cache
+ */
+Number runTestExplicit(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                       int const nb_tuples = 7, int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " explicit", nb_distinct_outputs);
+    std::cout << "nb_tuples:" << nb_tuples << std::endl;
+    for(int i = 0; i < problem.batch_count; i++)
+    {
+        for(int d = 0; d < problem.matrix_count; d++)
+        {
+            problem.matrix_list_batched()[i * problem.matrix_count + d] = problem.matrices[0]->rawPointer[(i % nb_tuples) * problem.matrix_count + d];
+        }
+    }
+
+    return runTestKernel(problem, "explicit Kronmult", [&](BatchedProblem &p) {
+        kronmult_tuple_groups const groups(p.matrix_count, p.matrix_list_batched(), p.batch_count);
+        kronmult_explicit_cache<Number> cache;
+        // the first call fills the cache, the second one is checked
+        ArrayBatch_withRepetition<Number> output_first(p.output);
+        kronmult_batched_explicit(p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride,
+                                  p.input_batched(), output_first.rawPointer, p.batch_count, groups, cache);
+        p.restore_inputs();
+        kronmult_batched_explicit(p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride,
+                                  p.input_batched(), p.output_batched(), p.batch_count, groups, cache);
+        bool const is_cache_correct = cache.size() == static_cast<std::size_t>(std::min(nb_tuples, p.batch_count));
+        if(not is_cache_correct) std::cerr << "Unexpected number of cached products: " << cache.size() << std::endl;
+        return is_cache_correct;
+    });
+}
+
+/*
+ * runs a test of `kronmult_batched_transposed` with the given parameters
+ * the reference applies the naive algorithm to explicitly transposed copies of the matrices
+ * `kronmult_function` lets you test a specific transposed implementation
+ */
+Number runTestTransposed(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                         KronmultFunction *kronmult_function = kronmult_batched_transposed<Number>,
+                         int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " transposed", nb_distinct_outputs);
+    int const matrix_size = problem.matrix_size;
+    int const matrix_stride = problem.matrix_stride;
+    int const nb_matrices = problem.batch_count * problem.matrix_count;
+    ArrayBatch<Number> matrices_transposed(matrix_size * matrix_stride, nb_matrices);
+    for(int i = 0; i < nb_matrices; i++)
+    {
+        Number const *const matrix = problem.matrix_list_batched()[i];
+        Number *const matrix_transposed = matrices_transposed.rawPointer[i];
+        for(int r = 0; r < matrix_size; r++)
+        {
+            for(int c = 0; c < matrix_size; c++) matrix_transposed[r + c * matrix_stride] = matrix[c + r * matrix_stride];
+        }
+    }
+    // the reference reads the transposed copies, the kernel the original matrices
+    problem.matrix_lists[0].assign(matrices_transposed.rawPointer, matrices_transposed.rawPointer + nb_matrices);
 
+    return runTestKernel(problem, "transposed Kronmult", [&](BatchedProblem &p) {
+        kronmult_function(p.matrix_count, p.matrix_size, p.matrices[0]->rawPointer, p.matrix_stride, p.input_batched(),
+                          p.output_batched(), p.workspace_batched(), p.batch_count);
+        return true;
+    });
+}
+
+/*
+ * `kronmult_batched_teams` with teams of `team_size` threads, whatever `KRONMULT_TEAM_SIZE` is
+ */
+template<int team_size, bool transposed = false>
+void kronmult_batched_teams_of(int const matrix_count, int const matrix_size, Number const *const matrix_list_batched[],
+                               int const matrix_stride, Number *input_batched[], Number *output_batched[],
+                               Number *workspace_batched[], int const nb_batch)
+{
+    kronmult_batched_teams<Number, transposed>(matrix_count, matrix_size, matrix_list_batched, matrix_stride,
+                                               input_batched, output_batched, workspace_batched, nb_batch, team_size);
+}
+
+/*
+ * runs `kronmult_batched_teams` with at least `nb_threads` threads, such that teams are formed even on small machines
+ * teams of 2 threads (several teams sharing outputs) and of 3 threads (a single team, whose columns do not split
+ * evenly) are checked, as well as the transposed product, and the largest error is returned
+ */
+Number runTestTeams(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                    int const nb_threads = 4)
+{
+    int const previous_nb_threads = omp_get_max_threads();
+    omp_set_num_threads(std::max(nb_threads, previous_nb_threads));
+    Number error = runTest(degree, dimension, grid_level, benchName, kronmult_batched_teams_of<2>);
+    error = std::max(error, runTest(degree, dimension, grid_level, benchName, kronmult_batched_teams_of<3>));
+    error = std::max(error, runTestTransposed(degree, dimension, grid_level, benchName,
+                                              kronmult_batched_teams_of<2, true>));
+    omp_set_num_threads(previous_nb_threads);
     return error;
 }
 
+/*
+ * serial lanes version of `kronmult_batched` running the variant of the lanes kernel compiled for `isa`
+ * whatever instruction set was picked at startup
+ */
+template<kronmult_isa isa>
+void kronmult_batched_lanes_on(int const matrix_count, int const matrix_size, Number const *const matrix_list_batched[],
+                               int const matrix_stride, Number *input_batched[], Number *output_batched[],
+                               Number * /*workspace_batched*/[], int const nb_batch)
+{
+    constexpr int lanes = kronmult_lanes_count<Number>;
+    int const size_input = pow_int(matrix_size, matrix_count);
+    std::vector<Number> workspace(size_input * lanes);
+    std::vector<Number> workspace2(size_input * lanes);
+    std::vector<Number> matrix_workspace(matrix_size * matrix_size * lanes);
+    for(int first = 0; first < nb_batch; first += lanes)
+    {
+        int const nb_elements = std::min(lanes, nb_batch - first);
+        kronmult_dispatch_to<kronmult_lanes_kernel<Number, lanes>>(
+            isa, matrix_count, matrix_size, matrix_list_batched, matrix_stride, input_batched, output_batched, first,
+            nb_elements, size_input, workspace.data(), workspace2.data(), matrix_workspace.data(), true);
+    }
+}
+
+/*
+ * runs the lanes kernel compiled for each instruction set supported by this CPU (up to `KRONMULT_ISA`)
+ * such that all the variants are checked on a machine that would only ever dispatch to the widest one
+ * returns the largest error
+ */
+Number runTestDispatch(int const degree, int const dimension, int const grid_level, std::string const benchName)
+{
+    kronmult_isa const widest = kronmult_detect_isa();
+    std::cout << "Dispatching the native kernels to: " << kronmult_dispatched_isa()
+              << " (widest supported: " << kronmult_isa_name(widest) << ")" << std::endl;
+    Number error = runTest(degree, dimension, grid_level, benchName, kronmult_batched_lanes_on<kronmult_isa::generic>);
+    if(widest >= kronmult_isa::avx2)
+    {
+        error = std::max(error, runTest(degree, dimension, grid_level, benchName, kronmult_batched_lanes_on<kronmult_isa::avx2>));
+    }
+    if(widest >= kronmult_isa::avx512)
+    {
+        error = std::max(error, runTest(degree, dimension, grid_level, benchName, kronmult_batched_lanes_on<kronmult_isa::avx512>));
+    }
+    return error;
+}
+
+/*
+ * runs a test of `kron_operator` and of the Krylov solvers on a block tridiagonal operator with `nb_blocks` blocks
+ * the diagonal blocks are kronecker products of symmetric positive definite matrices and the off-diagonal blocks
+ * are small, they are transposed of one another for the conjugate gradient and independent for GMRES
+ * returns the largest relative error on the solutions
+ */
+Number runTestKrylov(int const degree, int const dimension, int const nb_blocks, std::string const benchName)
+{
+    // Kronmult parameters
+    int const matrix_size   = degree;
+    int const matrix_count  = dimension;
+    int const size_input    = pow_int(matrix_size, matrix_count);
+    int const matrix_stride = matrix_size;
+    int const vector_size   = nb_blocks * size_input;
+    std::cout << benchName << " krylov benchcase"
+              << " nb_blocks:" << nb_blocks << " matrix_size:" << matrix_size
+              << " matrix_count:" << matrix_count << " size_input:" << size_input << std::endl;
+
+    // symmetric positive definite diagonal matrices, and small lower and upper coupling matrices
+    std::default_random_engine rng(42);
+    std::uniform_real_distribution<Number> distribution(-1., 1.);
+    ArrayBatch<Number> diagonal(matrix_size * matrix_size, nb_blocks * matrix_count);
+    ArrayBatch<Number> lower(matrix_size * matrix_size, nb_blocks * matrix_count);
+    ArrayBatch<Number> lower_transposed(matrix_size * matrix_size, nb_blocks * matrix_count);
+    ArrayBatch<Number> upper(matrix_size * matrix_size, nb_blocks * matrix_count);
+    for(int m = 0; m < nb_blocks * matrix_count; m++)
+    {
+        std::vector<Number> random(matrix_size * matrix_size);
+        for(Number &value : random) value = distribution(rng);
+        for(int r = 0; r < matrix_size; r++)
+        {
+            for(int c = 0; c < matrix_size; c++)
+            {
+                Number value = (r == c) ? 1. : 0.;
+                for(int k = 0; k < matrix_size; k++) value += random[r + k * matrix_size] * random[c + k * matrix_size] / matrix_size;
+                diagonal.rawPointer[m][r + c * matrix_size] = value;
+                lower.rawPointer[m][r + c * matrix_size] = 0.2 * distribution(rng);
+                upper.rawPointer[m][r + c * matrix_size] = 0.2 * distribution(rng);
+            }
+        }
+        for(int r = 0; r < matrix_size; r++)
+        {
+            for(int c = 0; c < matrix_size; c++) lower_transposed.rawPointer[m][r + c * matrix_size] = lower.rawPointer[m][c + r * matrix_size];
+        }
+    }
+
+    // builds both operators
+    auto build_operator = [&](ArrayBatch<Number> const &upper_matrices) {
+        std::vector<Number const *> matrix_list_batched;
+        std::vector<size_t> input_offsets, output_offsets;
+        auto add_element = [&](ArrayBatch<Number> const &matrices, int const from, int const to) {
+            for(int d = 0; d < matrix_count; d++) matrix_list_batched.push_back(matrices.rawPointer[from * matrix_count + d]);
+            input_offsets.push_back(from * size_input);
+            output_offsets.push_back(to * size_input);
+        };
+        for(int i = 0; i < nb_blocks; i++)
+        {
+            add_element(diagonal, i, i);
+            if(i + 1 < nb_blocks)
+            {
+                add_element(lower, i, i + 1);
+                add_element(upper_matrices, i + 1, i);
+            }
+        }
+        int const nb_batch = static_cast<int>(input_offsets.size());
+        return kron_operator<Number>(matrix_count, matrix_size, matrix_list_batched.data(), matrix_stride,
+                                     input_offsets.data(), output_offsets.data(), nb_batch, vector_size);
+    };
+    ArrayBatch<Number> upper_symmetric(matrix_size * matrix_size, nb_blocks * matrix_count);
+    for(int i = 0; i + 1 < nb_blocks; i++)
+    {
+        // the upper element going from block i+1 to block i is the transposed of the lower element from i to i+1
+        for(int d = 0; d < matrix_count; d++)
+        {
+            std::copy_n(lower_transposed.rawPointer[i * matrix_count + d], matrix_size * matrix_size,
+                        upper_symmetric.rawPointer[(i + 1) * matrix_count + d]);
+        }
+    }
+    kron_operator<Number> const symmetric_operator = build_operator(upper_symmetric);
+    kron_operator<Number> const general_operator = build_operator(upper);
+
+    // checks the transposed application: <K x, y> = <x, K^T y>
+    std::vector<Number> x(vector_size), y(vector_size), Kx(vector_size), KTy(vector_size);
+    for(int i = 0; i < vector_size; i++)
+    {
+        x[i] = distribution(rng);
+        y[i] = distribution(rng);
+    }
+    general_operator.apply(x.data(), Kx.data());
+    general_operator.apply_transposed(y.data(), KTy.data());
+    Number dot_Kx_y = 0.;
+    Number dot_x_KTy = 0.;
+    for(int i = 0; i < vector_size; i++)
+    {
+        dot_Kx_y += Kx[i] * y[i];
+        dot_x_KTy += x[i] * KTy[i];
+    }
+    Number error = std::abs(dot_Kx_y - dot_x_KTy) / std::abs(dot_Kx_y);
+    std::cout << "Transposed application error: " << error << std::endl;
+
+    // solves K solution = K x starting from zero and compares the solution to x
+    auto check_solver = [&](kron_operator<Number> const &op, auto solver, std::string const solverName) {
+        std::vector<Number> rhs(vector_size), solution(vector_size, 0.);
+        op.apply(x.data(), rhs.data());
+        krylov_result<Number> const result = solver(op, rhs.data(), solution.data());
+        Number difference = 0.;
+        Number norm = 0.;
+        for(int i = 0; i < vector_size; i++)
+        {
+            difference += (solution[i] - x[i]) * (solution[i] - x[i]);
+            norm += x[i] * x[i];
+        }
+        Number const solver_error = result.converged ? std::sqrt(difference / norm) : 1.;
+        std::cout << solverName << " iterations:" << result.iterations << " residual:" << result.residual_norm
+                  << " error:" << solver_error << std::endl;
+        return solver_error;
+    };
+    Number const tolerance = 1e-12;
+    error = std::max(error, check_solver(symmetric_operator, [&](auto const &op, Number const *rhs, Number *solution) {
+        return kron_cg(op, rhs, solution, tolerance, 1000);
+    }, "CG"));
+    error = std::max(error, check_solver(general_operator, [&](auto const &op, Number const *rhs, Number *solution) {
+        return kron_gmres(op, rhs, solution, tolerance, 1000, 20);
+    }, "GMRES"));
+
+    return check_error(error);
+}
+
+/*
+ * runs a test of `kron_rk4_step` on a block tridiagonal operator made of `nb_blocks` blocks
+ * the reference applies the operator and updates the vectors in separate sweeps, as one would without fused stages
+ */
+Number runTestTimeStepping(int const degree, int const dimension, int const nb_blocks, std::string const benchName)
+{
+    // Kronmult parameters
+    int const matrix_size   = degree;
+    int const matrix_count  = dimension;
+    int const size_input    = pow_int(matrix_size, matrix_count);
+    int const matrix_stride = matrix_size;
+    int const vector_size   = nb_blocks * size_input;
+    std::cout << benchName << " time stepping benchcase"
+              << " nb_blocks:" << nb_blocks << " matrix_size:" << matrix_size
+              << " matrix_count:" << matrix_count << " size_input:" << size_input << std::endl;
+
+    // operator coupling each block to itself and to its neighbours
+    std::default_random_engine rng(42);
+    std::uniform_real_distribution<Number> distribution(-1., 1.);
+    ArrayBatch<Number> matrices(matrix_size * matrix_size, 3 * nb_blocks * matrix_count);
+    for(size_t m = 0; m < matrices.nb_arrays; m++)
+    {
+        for(int j = 0; j < matrix_size * matrix_size; j++) matrices.rawPointer[m][j] = 0.5 * distribution(rng);
+    }
+    std::vector<Number const *> matrix_list_batched;
+    std::vector<size_t> input_offsets, output_offsets;
+    for(int i = 0; i < nb_blocks; i++)
+    {
+        for(int neighbour = i - 1; neighbour <= i + 1; neighbour++)
+        {
+            if((neighbour < 0) or (neighbour >= nb_blocks)) continue;
+            int const element = static_cast<int>(input_offsets.size());
+            for(int d = 0; d < matrix_count; d++) matrix_list_batched.push_back(matrices.rawPointer[element * matrix_count + d]);
+            input_offsets.push_back(neighbour * size_input);
+            output_offsets.push_back(i * size_input);
+        }
+    }
+    int const nb_batch = static_cast<int>(input_offsets.size());
+    kron_operator<Number> const op(matrix_count, matrix_size, matrix_list_batched.data(), matrix_stride,
+                                   input_offsets.data(), output_offsets.data(), nb_batch, vector_size);
+
+    std::vector<Number> x(vector_size);
+    for(Number &value : x) value = distribution(rng);
+    Number const dt = 0.01;
+    int const nb_steps = 3;
+
+    // reference, with separate operator applications and vector updates
+    std::cout << "Starting unfused Runge-Kutta" << std::endl;
+    std::vector<Number> expected(x), k1(vector_size), k2(vector_size), k3(vector_size), k4(vector_size), u(vector_size);
+    for(int step = 0; step < nb_steps; step++)
+    {
+        op.apply(expected.data(), k1.data());
+        for(int i = 0; i < vector_size; i++) u[i] = expected[i] + dt / 2 * k1[i];
+        op.apply(u.data(), k2.data());
+        for(int i = 0; i < vector_size; i++) u[i] = expected[i] + dt / 2 * k2[i];
+        op.apply(u.data(), k3.data());
+        for(int i = 0; i < vector_size; i++) u[i] = expected[i] + dt * k3[i];
+        op.apply(u.data(), k4.data());
+        for(int i = 0; i < vector_size; i++) expected[i] += dt / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+    }
+
+    // fused stages, out of place for the first step and in place for the others
+    std::cout << "Starting fused Runge-Kutta" << std::endl;
+    std::vector<Number> result(vector_size), workspace(3 * vector_size);
+    kron_rk4_step(op, dt, x.data(), result.data(), workspace.data());
+    for(int step = 1; step < nb_steps; step++) kron_rk4_step(op, dt, result.data(), result.data(), workspace.data());
+
+    std::cout << "Computing error" << std::endl;
+    Number difference = 0.;
+    Number norm = 0.;
+    for(int i = 0; i < vector_size; i++)
+    {
+        difference = std::max(difference, std::abs(result[i] - expected[i]));
+        norm = std::max(norm, std::abs(expected[i]));
+    }
+    Number const error = difference / norm;
+    return check_error(error);
+}
+
+/*
+ * runs a test of `kronmult_batched_sparse_grid` on a sparse grid of the given dimension and level
+ * each element is connected to itself and to about half of the other elements, the reference builds the
+ * corresponding pointer arrays and calls `kronmult_batched`
+ */
+Number runTestSparseGrid(int const degree, int const dimension, int const grid_level, std::string const benchName)
+{
+    // lists the elements of the sparse grid
+    SparseGrid const grid = make_sparse_grid(dimension, grid_level);
+    std::vector<int> const &element_levels = grid.levels;
+    std::vector<int> const &element_cells = grid.cells;
+    int const nb_elements = grid.nb_elements();
+
+    // random connectivity
+    std::default_random_engine rng(42);
+    std::bernoulli_distribution is_connected(0.5);
+    std::vector<int> connectivity_starts(1, 0), connectivity;
+    for(int i = 0; i < nb_elements; i++)
+    {
+        for(int j = 0; j < nb_elements; j++)
+        {
+            if((i == j) or is_connected(rng)) connectivity.push_back(j);
+        }
+        connectivity_starts.push_back(static_cast<int>(connectivity.size()));
+    }
+
+    // Kronmult parameters
+    int const matrix_size     = degree;
+    int const matrix_count    = dimension;
+    int const size_input      = pow_int(matrix_size, matrix_count);
+    int const operator_size   = matrix_size * pow_int(2, grid_level);
+    int const operator_stride = operator_size + 3; // padding, modelize the fact that columns are not adjascent in memory
+    kronmult_sparse_grid_batch const batch = kronmult_build_sparse_grid_batch(matrix_count, nb_elements, element_levels.data(),
+                                                                              element_cells.data(), connectivity_starts.data(),
+                                                                              connectivity.data());
+    int const batch_count = batch.nb_batch();
+    std::cout << benchName << " sparse grid benchcase"
+              << " nb_elements:" << nb_elements << " batch_count:" << batch_count << " matrix_size:" << matrix_size
+              << " matrix_count:" << matrix_count << " size_input:" << size_input << std::endl;
+
+    std::cout << "Starting allocation." << std::endl;
+    bool const should_initialize_data = true;
+    ArrayBatch<Number> operators(operator_size * operator_stride, matrix_count, should_initialize_data);
+    ArrayBatch<Number> input(size_input * nb_elements, 1, should_initialize_data);
+    ArrayBatch<Number> output(size_input * nb_elements, 1, should_initialize_data);
+    std::vector<Number> output2(output.rawPointer[0], output.rawPointer[0] + size_input * nb_elements);
+
+    // pointer arrays, as they would be built without the sparse grid batch
+    ArrayBatch<Number> input_batched(size_input, batch_count);
+    ArrayBatch<Number> workspace_batched(size_input, batch_count);
+    std::vector<Number const *> matrix_list_batched;
+    std::vector<Number *> output_batched;
+    for(int i = 0; i < nb_elements; i++)
+    {
+        for(int k = connectivity_starts[i]; k < connectivity_starts[i + 1]; k++)
+        {
+            int const j = connectivity[k];
+            for(int d = 0; d < matrix_count; d++)
+            {
+                int const row = kronmult_hierarchical_index(element_levels[i * dimension + d], element_cells[i * dimension + d]);
+                int const col = kronmult_hierarchical_index(element_levels[j * dimension + d], element_cells[j * dimension + d]);
+                matrix_list_batched.push_back(&operators.rawPointer[d][row * matrix_size + col * matrix_size * operator_stride]);
+            }
+            std::copy_n(&input.rawPointer[0][j * size_input], size_input, input_batched.rawPointer[k]);
+            output_batched.push_back(&output.rawPointer[0][i * size_input]);
+        }
+    }
+
+    std::cout << "Starting Kronmult" << std::endl;
+    kronmult_batched(matrix_count, matrix_size, matrix_list_batched.data(), operator_stride, input_batched.rawPointer,
+                     output_batched.data(), workspace_batched.rawPointer, batch_count);
+
+    std::cout << "Starting sparse grid Kronmult" << std::endl;
+    kronmult_batched_sparse_grid(batch, matrix_size, operators.rawPointer, operator_stride, input.rawPointer[0], output2.data());
+
+    std::cout << "Computing error" << std::endl;
+    Number error = 0.;
+    for(int n = 0; n < size_input * nb_elements; n++)
+    {
+        error = std::max(error, std::abs(output.rawPointer[0][n] - output2[n]) / std::max(Number{1}, std::abs(output2[n])));
+    }
+    return check_error(error);
+}
+
+/*
+ * runs a test of `kronmult_batched_streaming` with the given parameters
+ * the generator copies the inputs of each chunk into a double-buffered storage
+ */
+Number runTestStreaming(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                        int const chunk_size = 7, int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " streaming", nb_distinct_outputs);
+    std::cout << "chunk_size:" << chunk_size << std::endl;
+    ArrayBatch<Number> input_slots(problem.size_input, 2 * chunk_size); // double-buffered inputs for the streaming
+
+    return runTestKernel(problem, "streaming Kronmult", [&](BatchedProblem &p) {
+        auto generator = [&](kronmult_chunk<Number> &chunk) {
+            for(int i = 0; i < chunk.nb_batch; i++)
+            {
+                int const k = chunk.first + i;
+                Number *input = input_slots.rawPointer[chunk.slot * chunk_size + i];
+                std::copy_n(p.input_batched()[k], p.size_input, input);
+                chunk.input_batched[i] = input;
+                chunk.output_batched[i] = p.output_batched()[k];
+                for(int m = 0; m < p.matrix_count; m++)
+                {
+                    chunk.matrix_list_batched[i * p.matrix_count + m] = p.matrix_list_batched()[k * p.matrix_count + m];
+                }
+            }
+        };
+        kronmult_batched_streaming<Number>(p.matrix_count, p.matrix_size, p.matrix_stride, p.batch_count, chunk_size, generator);
+
+        // a chunk size that would never advance is rejected
+        bool rejected = false;
+        try
+        {
+            kronmult_batched_streaming<Number>(p.matrix_count, p.matrix_size, p.matrix_stride, p.batch_count, 0, generator);
+        }
+        catch(std::invalid_argument const &)
+        {
+            rejected = true;
+        }
+        if(not rejected) std::cerr << "Streaming accepted a chunk size of 0!" << std::endl;
+
+        // a generator failing while a chunk is being computed, its exception should be propagated once the chunk is done
+        ArrayBatch_withRepetition<Number> output_discarded(p.output);
+        auto failing_generator = [&](kronmult_chunk<Number> &chunk) {
+            if(chunk.first > 0) throw std::runtime_error("generator failure");
+            generator(chunk);
+            for(int i = 0; i < chunk.nb_batch; i++) chunk.output_batched[i] = output_discarded.rawPointer[chunk.first + i];
+        };
+        bool propagated = false;
+        try
+        {
+            kronmult_batched_streaming<Number>(p.matrix_count, p.matrix_size, p.matrix_stride, p.batch_count, chunk_size, failing_generator);
+        }
+        catch(std::runtime_error const &)
+        {
+            propagated = true;
+        }
+        if(not propagated) std::cerr << "Streaming lost the exception of its generator!" << std::endl;
+
+        return rejected and propagated;
+    });
+}
+
+/*
+ * runs a test of `kronmult_capture` and `kronmult_problem_file` with the given parameters
+ * captures a problem, reloads it and checks that replaying it produces the same output as the naive reference
+ */
+Number runTestCapture(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                      int const nb_distinct_outputs = 5)
+{
+    BatchedProblem problem(degree, dimension, grid_level, benchName + " capture", nb_distinct_outputs);
+    std::string const path = "kronmult_test_capture.kron";
+
+    return runTestKernel(problem, "capture and replayed Kronmult", [&](BatchedProblem &p) {
+        kronmult_capture<Number>(path, p.matrix_count, p.matrix_size, p.matrix_list_batched(), p.matrix_stride,
+                                 p.input_batched(), p.output_batched(), p.batch_count);
+        kronmult_problem_file<Number> file(path);
+        std::cout << "Loaded " << file.nb_matrices << " matrices, " << file.nb_inputs << " inputs and "
+                  << file.nb_outputs << " outputs" << std::endl;
+        bool const is_sharing_preserved = (file.nb_matrices == p.batch_count * p.matrix_count)
+                                          and (file.nb_outputs == p.nb_distinct_outputs);
+        if(not is_sharing_preserved) std::cerr << "The sharing pattern was not preserved!" << std::endl;
+
+        // the replay writes into the file, its outputs are copied back into the problem
+        kronmult_batched(file.matrix_count, file.matrix_size, file.matrix_list_batched.data(), file.matrix_stride,
+                         file.input_batched.data(), file.output_batched.data(), p.workspace_batched(), file.nb_batch);
+        for(int i = 0; i < p.batch_count; i++) std::copy_n(file.output_batched[i], p.size_input, p.output_batched()[i]);
+
+        // corrupted copies of the file should be rejected when loaded
+        std::string const corrupted_path = path + ".corrupted";
+        auto is_rejected = [&](auto corrupt) {
+            std::ifstream input(path, std::ios::binary);
+            std::vector<char> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+            kronmult_file_header header;
+            std::memcpy(&header, bytes.data(), sizeof(header));
+            corrupt(bytes, header);
+            std::memcpy(bytes.data(), &header, sizeof(header));
+            std::ofstream(corrupted_path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+            bool rejected = false;
+            try
+            {
+                kronmult_problem_file<Number> const corrupted(corrupted_path);
+            }
+            catch(std::runtime_error const &)
+            {
+                rejected = true;
+            }
+            std::remove(corrupted_path.c_str());
+            return rejected;
+        };
+        // truncated outputs, with a consistent file size
+        bool const rejects_truncated = is_rejected([](std::vector<char> &bytes, kronmult_file_header &header) {
+            bytes.resize(header.outputs_offset + sizeof(Number));
+            header.file_size = bytes.size();
+        });
+        // matrix index past the stored matrices
+        bool const rejects_index = is_rejected([](std::vector<char> &bytes, kronmult_file_header &header) {
+            std::int64_t const index = header.nb_matrices;
+            std::memcpy(&bytes[header.matrix_indices_offset], &index, sizeof(index));
+        });
+        // section offset past the end of the file
+        bool const rejects_offset = is_rejected([](std::vector<char> &, kronmult_file_header &header) {
+            header.inputs_offset = header.file_size + kronmult_file_alignment;
+        });
+        std::remove(path.c_str());
+        bool const rejects_corrupted = rejects_truncated and rejects_index and rejects_offset;
+        if(not rejects_corrupted) std::cerr << "A corrupted file was loaded!" << std::endl;
+
+        return is_sharing_preserved and rejects_corrupted;
+    });
+}
+
 /*
  * Runs tests of increasing sizes and displays the results
  */
 int main()
 {
     std::cout << "Starting tests (" << omp_get_num_procs() << " procs)." << std::endl;
+    std::cout << "Build: " << kronmult_build_info_string() << std::endl;
     #ifdef KRONMULT_USE_BLAS
         std::cout << "Using BLAS." << std::endl;
     #endif
@@ -65,10 +1061,75 @@ int main()
     // running the benchmarks
     auto toy   = runTest(4, 1, 2, "toy");
     auto small = runTest(4, 2, 4, "small");
+    auto parallel = runTest(4, 2, 4, "small", kronmult_batched_parallel<Number>);
+    auto lanes = runTest(3, 1, 2, "tiny", kronmult_batched_lanes_serial<Number>);
+    auto lanes_parallel = runTest(4, 2, 4, "small", kronmult_batched_lanes_parallel<Number>);
+    auto explicit_product = runTest(4, 2, 4, "small", kronmult_batched_explicit<Number>);
+    auto explicit_shared = runTestExplicit(4, 2, 4, "small");
+    auto transposed = runTestTransposed(4, 2, 4, "small");
+    auto transposed_parallel = runTestTransposed(4, 3, 3, "medium", kronmult_batched_parallel<Number, true>);
+    auto deterministic = runTestDeterministic(4, 3, 6, "medium");
+    auto teams = runTestTeams(4, 3, 6, "medium");
+    auto dispatch = runTestDispatch(3, 2, 4, "small");
+    auto arena = runTestArena(4, 2, 4, "small");
+    auto zeros = runTestZeros(4, 3, 6, "medium");
+    auto zeros_single_matrix = runTestZeros(4, 1, 6, "toy");
+    auto krylov = runTestKrylov(4, 3, 64, "medium");
+    auto time_stepping = runTestTimeStepping(4, 3, 64, "medium");
+    auto time_stepping_serial = runTestTimeStepping(3, 2, 4, "small");
+    auto sparse_grid = runTestSparseGrid(3, 3, 3, "small");
+    auto async = runTestAsync(4, 2, 4, "small");
+    auto terms = runTestTerms(4, 2, 4, "small");
+    auto terms_medium = runTestTerms(4, 3, 6, "medium");
+    auto kronecker_sum = runTestKroneckerSum(4, 3, 6, "medium");
+    auto kronecker_sum_small = runTestKroneckerSum(3, 2, 2, "tiny");
+    auto streaming = runTestStreaming(4, 2, 4, "small");
+    auto capture = runTestCapture(4, 2, 4, "small");
+    // sampled verification, usable at the sizes that the naive implementation cannot reach
+    auto sampled_small = runTestSampled(4, 2, 4, "small", 64);
+    auto sampled_medium = runTestSampled(6, 3, 6, "medium", 64);
+    auto sampled_large = runTestSampled(8, 6, 7, "large", 32);
+    auto workload = runTestWorkload(3, 3, 4, "small", 1 << 30);
+    auto workload_capped = runTestWorkload(4, 4, 5, "medium", 512);
 
-    // display results
-    std::cout << std::endl
-              << "Errors:" << std::endl
-              << "toy: " << toy << std::endl
-              << "small: " << small << std::endl;
+    // displays the results and lets ctest know whether the tests passed, naming the ones that failed
+    std::cout << std::endl << "Errors:" << std::endl;
+    bool success = true;
+    auto report = [&](std::string const name, Number const error) {
+        bool const passed = error <= 1e-7;
+        std::cout << name << ": " << error << (passed ? "" : " FAILED") << std::endl;
+        success = success and passed;
+    };
+    report("toy", toy);
+    report("small", small);
+    report("small (parallel)", parallel);
+    report("tiny (lanes)", lanes);
+    report("small (parallel lanes)", lanes_parallel);
+    report("small (explicit)", explicit_product);
+    report("explicit (shared matrices)", explicit_shared);
+    report("small (transposed)", transposed);
+    report("medium (parallel transposed)", transposed_parallel);
+    report("medium (deterministic)", deterministic);
+    report("medium (teams)", teams);
+    report("small (dispatch)", dispatch);
+    report("small (arena)", arena);
+    report("medium (zeros)", zeros);
+    report("toy (zeros)", zeros_single_matrix);
+    report("krylov", krylov);
+    report("medium (time stepping)", time_stepping);
+    report("small (time stepping)", time_stepping_serial);
+    report("sparse grid", sparse_grid);
+    report("async", async);
+    report("terms", terms);
+    report("medium (terms)", terms_medium);
+    report("medium (kronecker sum)", kronecker_sum);
+    report("tiny (kronecker sum)", kronecker_sum_small);
+    report("streaming", streaming);
+    report("capture", capture);
+    report("small (sampled)", sampled_small);
+    report("medium (sampled)", sampled_medium);
+    report("large (sampled)", sampled_large);
+    report("small (sparse grid workload)", workload);
+    report("medium (capped sparse grid workload)", workload_capped);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,121 @@
+#include "utils/data_generation.h"
+#include "utils/sparse_grid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <kronmult_mpi.hpp>
+#include <random>
+#include <vector>
+
+// change this to run the test in another precision
+using Number = double;
+
+/*
+ * runs a test of `kronmult_distributed` on a sparse grid of the given dimension and level
+ * every rank builds the whole problem (with the same seed), computes it with `kronmult_batched_sparse_grid` and
+ * compares the part it owns with the distributed result
+ */
+Number runTestDistributed(int const degree, int const dimension, int const grid_level, std::string const benchName)
+{
+    int rank, nb_ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nb_ranks);
+
+    // sparse grid problem
+    SparseGrid const grid = make_sparse_grid(dimension, grid_level);
+    std::vector<int> connectivity_starts, connectivity;
+    make_sparse_grid_connectivity(grid, connectivity_starts, connectivity);
+    int const nb_elements = grid.nb_elements();
+    kronmult_sparse_grid_batch const batch =
+        kronmult_build_sparse_grid_batch(dimension, nb_elements, grid.levels.data(), grid.cells.data(),
+                                         connectivity_starts.data(), connectivity.data());
+
+    // Kronmult parameters
+    int const matrix_size     = degree;
+    int const matrix_count    = dimension;
+    int const size_input      = pow_int(matrix_size, matrix_count);
+    int const operator_size   = matrix_size * pow_int(2, grid_level);
+    int const operator_stride = operator_size;
+    if(rank == 0)
+    {
+        std::cout << benchName << " distributed benchcase"
+                  << " nb_ranks:" << nb_ranks << " nb_elements:" << nb_elements << " batch_count:" << batch.nb_batch()
+                  << " matrix_size:" << matrix_size << " matrix_count:" << matrix_count << " size_input:" << size_input
+                  << std::endl;
+    }
+
+    // same data on all ranks
+    std::default_random_engine rng(42);
+    std::vector<std::vector<Number>> operators(matrix_count, std::vector<Number>(operator_size * operator_stride));
+    std::vector<Number const *> operator_pointers;
+    for(auto &op : operators)
+    {
+        fillArray(op.data(), op.size(), rng);
+        operator_pointers.push_back(op.data());
+    }
+    std::vector<Number> input(static_cast<size_t>(nb_elements) * size_input);
+    std::vector<Number> output(static_cast<size_t>(nb_elements) * size_input);
+    fillArray(input.data(), input.size(), rng);
+    fillArray(output.data(), output.size(), rng);
+
+    // distributed computation on the local part of the vectors
+    kronmult_distributed<Number> distributed(MPI_COMM_WORLD, batch, matrix_size);
+    size_t const first    = static_cast<size_t>(distributed.first_element()) * size_input;
+    size_t const nb_local = static_cast<size_t>(distributed.nb_local_elements()) * size_input;
+    std::vector<Number> local_input(input.begin() + first, input.begin() + first + nb_local);
+    std::vector<Number> local_output(output.begin() + first, output.begin() + first + nb_local);
+    distributed.apply(operator_pointers.data(), operator_stride, local_input.data(), local_output.data());
+
+    // reference
+    kronmult_batched_sparse_grid(batch, matrix_size, operator_pointers.data(), operator_stride, input.data(),
+                                 output.data());
+
+    // largest relative error over all ranks
+    Number local_error = 0.;
+    for(size_t n = 0; n < nb_local; n++)
+    {
+        Number const reference = output[first + n];
+        local_error = std::max(local_error, std::abs(local_output[n] - reference) / std::max(Number{1}, std::abs(reference)));
+    }
+    Number error;
+    MPI_Allreduce(&local_error, &error, 1, kronmult_mpi_type<Number>(), MPI_MAX, MPI_COMM_WORLD);
+    if(rank == 0)
+    {
+        std::cout << "Halo elements on rank 0: " << distributed.nb_halo_elements() << std::endl;
+        std::cout << "Error: " << error << std::endl;
+        if(error > 1e-7) std::cerr << "Test failed!" << std::endl;
+    }
+
+    return error;
+}
+
+/*
+ * Runs the distributed tests and displays the results
+ */
+int main(int argc, char **argv)
+{
+    MPI_Init(&argc, &argv);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if(rank == 0) std::cout << "Build: " << kronmult_build_info_string() << std::endl;
+
+    // running the tests
+    auto small = runTestDistributed(3, 2, 4, "small");
+    auto medium = runTestDistributed(2, 3, 4, "medium");
+
+    // display results
+    if(rank == 0)
+    {
+        std::cout << std::endl
+                  << "Errors:" << std::endl
+                  << "small: " << small << std::endl
+                  << "medium: " << medium << std::endl;
+    }
+
+    MPI_Finalize();
+
+    // lets ctest know whether the tests passed
+    bool const success = (small <= 1e-7) and (medium <= 1e-7);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
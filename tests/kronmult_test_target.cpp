@@ -0,0 +1,101 @@
+#include "utils/kronmult_naive.h"
+#include "utils/utils_cpu.h"
+#include "utils/utils_target.h"
+#include <cstdlib>
+#include <iostream>
+#include <kronmult_target.hpp>
+#include <kronmult_utils.hpp>
+#include "utils/batch_size.h"
+#include <omp.h>
+
+// change this to run the bench in another precision
+using Number = double;
+
+/*
+ * runs a test with the given parameters
+ * `nb_distinct_outputs` modelizes the fact that most outputs are identical
+ */
+Number runTest(int const degree, int const dimension, int const grid_level, std::string const benchName,
+               int const nb_distinct_outputs = 5)
+{
+    // Kronmult parameters
+    int const matrix_size  = degree;
+    int const matrix_count = dimension;
+    int const size_input   = pow_int(matrix_size, matrix_count);
+    int const matrix_stride = 67; // large prime integer, modelize the fact that columns are not adjascent in memory
+    int const batch_count = compute_batch_size(degree, dimension, grid_level, nb_distinct_outputs);
+    std::cout << benchName << " benchcase"
+              << " batch_count:" << batch_count << " matrix_size:" << matrix_size
+              << " matrix_count:" << matrix_count << " size_input:" << size_input
+              << " nb_distinct_outputs:" << nb_distinct_outputs << std::endl;
+
+    std::cout << "Starting allocation." << std::endl;
+    bool const should_initialize_data = true;
+    ArrayBatch<Number> matrix_list_batched(matrix_size * matrix_stride, batch_count * matrix_count, should_initialize_data);
+    ArrayBatch<Number> input_batched(size_input, batch_count, should_initialize_data);
+    ArrayBatch<Number> workspace_batched(size_input, batch_count, should_initialize_data);
+    ArrayBatch_withRepetition<Number> output_batched(size_input, batch_count, nb_distinct_outputs, should_initialize_data);
+    ArrayBatch_withRepetition<Number> output_batched2(output_batched); // copy as this will be modified by both algorithms
+
+    // copies the second problem on the device
+    TargetArrayBatch<Number> device_matrix_list_batched(matrix_list_batched.rawPointer, matrix_size * matrix_stride,
+                                                        batch_count * matrix_count);
+    TargetArrayBatch<Number> device_input_batched(input_batched.rawPointer, size_input, batch_count);
+    TargetArrayBatch<Number> device_workspace_batched(workspace_batched.rawPointer, size_input, batch_count);
+    TargetArrayBatch<Number> device_output_batched(output_batched2.rawPointer, size_input, batch_count);
+
+    std::cout << "Starting Naive Kronmult" << std::endl;
+    kronmult_batched_naive(matrix_count, matrix_size, matrix_list_batched.rawPointer, matrix_stride,
+                           input_batched.rawPointer, output_batched.rawPointer, workspace_batched.rawPointer,
+                           batch_count);
+
+    std::cout << "Starting Kronmult" << std::endl;
+    kronmult_batched_target<Number>(matrix_count, matrix_size, device_matrix_list_batched.rawPointer, matrix_stride,
+                                    device_input_batched.rawPointer, device_output_batched.rawPointer,
+                                    device_workspace_batched.rawPointer, batch_count);
+    device_output_batched.copy_to_host();
+
+    std::cout << "Computing error" << std::endl;
+    Number const error = output_batched.distance(output_batched2);
+    std::cout << "Error: " << error << std::endl;
+    if(error > 1e-7) std::cerr << "Test failed!" << std::endl;
+
+    return error;
+}
+
+/*
+ * Runs tests of increasing sizes and displays the results
+ */
+int main()
+{
+    std::cout << "Starting tests." << std::endl;
+    // gets basic information on the OpenMP devices
+    int const nb_devices = omp_get_num_devices();
+    if (nb_devices > 0)
+    {
+        std::cout << "OpenMP device:" << omp_get_default_device() << " devicesAvailable:" << nb_devices << std::endl;
+    }
+    else
+    {
+        std::cout << "No OpenMP device, running on the host (" << omp_get_num_procs() << " procs)." << std::endl;
+    }
+
+    // running the benchmarks
+    auto toy    = runTest(4, 1, 2, "toy");
+    auto small  = runTest(4, 2, 4, "small");
+    auto medium = runTest(4, 3, 6, "medium");
+    // more elements than threads in a team
+    auto wide = runTest(6, 4, 2, "wide");
+
+    // display results
+    std::cout << std::endl
+              << "Errors:" << std::endl
+              << "toy: " << toy << std::endl
+              << "small: " << small << std::endl
+              << "medium: " << medium << std::endl
+              << "wide: " << wide << std::endl;
+
+    // lets ctest know whether the tests passed
+    bool const success = (toy <= 1e-7) and (small <= 1e-7) and (medium <= 1e-7) and (wide <= 1e-7);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
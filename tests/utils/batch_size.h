@@ -1,5 +1,14 @@
 #pragma once
 
+/*
+ * returns the theorical batch size for the given parameters
+ * the resulting batch might be too large to be allocated, use `kronmult_batched_streaming` to run it
+ */
+int compute_batch_size_unbounded(int const /*degree*/, int const dimension, int const grid_level)
+{
+    return pow_int(2, grid_level) * pow_int(grid_level, std::min(1, dimension - 1));
+}
+
 /*
  * returns the batch size to be used with the given parameters
  * NOTE the use of long long is needed to avoid overflow in intermediate steps
@@ -16,6 +25,6 @@ int compute_batch_size(int const degree, int const dimension, int const grid_lev
     long long const max_element_number = 395000000000;
     long long const max_batch_count = (max_element_number - nb_distinct_outputs * size_input) / static_cast<long long>(size_input * (2 + matrix_count * matrix_size * matrix_size));
     // formula with theorical batch count
-    long long const formula_batch_count = pow_int(2, grid_level) * pow_int(grid_level, std::min(1, dimension - 1));
+    long long const formula_batch_count = compute_batch_size_unbounded(degree, dimension, grid_level);
     return std::min(max_batch_count, formula_batch_count);
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include "kronmult_reference.h"
+#include "workload.h"
+#include "batch_size.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+/*
+ * runs a benchmark with the given parameters on a batch built from a sparse grid, which reproduces the output
+ * aliasing, input reuse and matrix sharing of ASGarD
+ * the batch count is the same as for `runBench`, the batch covers a random subset of the output elements
+ * `kronmult_function` is the implementation benchmarked, called with the arguments of `kronmult_batched`
+ * if `check_outputs` is true, a random sample of the outputs is checked against the long double reference
+ * if `use_arena` is true, the vectors are allocated in a `kronmult_arena`
+ */
+template<typename T, typename KronmultFunction>
+long runBenchSparseGrid(int const degree, int const dimension, int const grid_level, std::string const benchName,
+                        KronmultFunction kronmult_function, bool const check_outputs = false,
+                        bool const use_arena = false)
+{
+    int const batch_count = compute_batch_size(degree, dimension, grid_level, 5);
+    std::cout << benchName << " sparse grid benchcase"
+              << " degree:" << degree << " dimension:" << dimension << " grid_level:" << grid_level << std::endl;
+
+    // allocates and builds the problem
+    std::cout << "Starting allocation." << std::endl;
+    SparseGridWorkload<T> workload(degree, dimension, grid_level, batch_count, check_outputs, use_arena);
+    workload.print_statistics(std::cout);
+
+    // the reference is computed before the inputs are used as workspaces (and is not timed)
+    std::unique_ptr<SampledVerification<T>> verification;
+    if (check_outputs)
+    {
+        std::cout << "Starting sampled reference" << std::endl;
+        verification.reset(new SampledVerification<T>(
+            workload.matrix_count, workload.matrix_size, workload.matrix_list_batched.data(), workload.matrix_stride,
+            workload.input_batched.data(), workload.output_batched.data(), workload.batch_count));
+    }
+
+    std::cout << "Starting Kronmult" << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+    kronmult_function(workload.matrix_count, workload.matrix_size, workload.matrix_list_batched.data(),
+                      workload.matrix_stride, workload.input_batched.data(), workload.output_batched.data(),
+                      workload.workspace_batched.data(), workload.batch_count);
+    auto stop         = std::chrono::high_resolution_clock::now();
+    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+    std::cout << "Runtime: " << milliseconds << "ms" << std::endl;
+
+    if (verification)
+    {
+        T const error = verification->error(workload.output_batched.data());
+        std::cout << "Sampled error: " << error << std::endl;
+        if(error > 1e-7) std::cerr << "Check failed!" << std::endl;
+    }
+
+    return milliseconds;
+}
@@ -81,9 +81,10 @@ void kronmult_naive(int const matrix_count, int const matrix_size, T *matrix_lis
     int stride_kron = matrix_stride;
     for (int m = 1; m < matrix_count; m++)
     {
-        // allocates new kronmat
+        // allocates new kronmat (a square matrix of size `size_kron`*`matrix_size`)
+        int const size_kron_new = size_kron * matrix_size;
         T *kronmat_new;
-        kronmat_new = malloc_f(size_kron * matrix_size);
+        kronmat_new = malloc_f(size_kron_new * size_kron_new);
         // does kronecker product
         T const *matrix = matrix_list[m];
         kronecker_product(kronmat, size_kron, stride_kron, matrix, matrix_size, matrix_stride, kronmat_new);
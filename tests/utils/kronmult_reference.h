@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+/*
+ * reference implementation of single entries of kronmult
+ *
+ * `kronmult_naive` forms the full Kronecker matrix, which is out of reach past the small test cases
+ * the functions of this file never form it: they contract the input with one row of each matrix, in long double,
+ * which costs about `size_input` operations per entry and per batch element
+ * they share no code with the kronmult implementations such that they can be used to validate them at any size
+ */
+
+/*
+ * computes the entry `row` of kron(matrix_list) * input in long double
+ * `magnitude` is set to the same entry computed with the absolute values of the coefficients, an upper bound on the
+ * magnitude of the terms that the entry sums (and thus the scale of its rounding errors)
+ */
+template<typename T>
+long double kronmult_reference_entry(int const matrix_count, int const matrix_size, T const *const matrix_list[],
+                                     int const matrix_stride, T const input[], long long const row,
+                                     long double &magnitude)
+{
+    // decomposes the row into one row per matrix, the first matrix being the outermost (slowest) dimension
+    std::vector<int> rows(matrix_count);
+    long long remainder = row;
+    for (int m = matrix_count - 1; m >= 0; m--)
+    {
+        rows[m] = static_cast<int>(remainder % matrix_size);
+        remainder /= matrix_size;
+    }
+
+    // copies the input in long double
+    size_t size = 1;
+    for (int m = 0; m < matrix_count; m++) size *= matrix_size;
+    std::vector<long double> values(input, input + size);
+    std::vector<long double> magnitudes(size);
+    for (size_t j = 0; j < size; j++) magnitudes[j] = std::abs(values[j]);
+
+    // contracts the innermost dimension with the matching row of its matrix until a single value remains
+    for (int m = matrix_count - 1; m >= 0; m--)
+    {
+        T const *const matrix = matrix_list[m];
+        size /= matrix_size;
+        for (size_t k = 0; k < size; k++)
+        {
+            long double value     = 0.;
+            long double value_abs = 0.;
+            for (int col = 0; col < matrix_size; col++)
+            {
+                long double const coefficient = matrix[rows[m] + col * matrix_stride];
+                value += coefficient * values[k * matrix_size + col];
+                value_abs += std::abs(coefficient) * magnitudes[k * matrix_size + col];
+            }
+            // k is below the indices that are still to be read
+            values[k]     = value;
+            magnitudes[k] = value_abs;
+        }
+    }
+
+    magnitude = magnitudes[0];
+    return values[0];
+}
+
+/*
+ * checks a random sample of the entries produced by a batched kronmult
+ *
+ * the reference values are computed at construction, with `kronmult_reference_entry`, from the matrices, inputs and
+ * initial outputs: the object must thus be built *before* running the implementation to be tested (which uses the
+ * inputs as workspaces)
+ * each sampled entry sums the contributions of all the batch elements sharing its output
+ */
+template<typename T>
+class SampledVerification
+{
+  public:
+    // samples `nb_samples` entries, among the outputs of random batch elements
+    SampledVerification(int const matrix_count, int const matrix_size, T const *const matrix_list_batched[],
+                        int const matrix_stride, T const *const input_batched[], T const *const output_batched[],
+                        int const nb_batch, int const nb_samples = 16)
+        : samples(nb_samples)
+    {
+        // random number generator for the sampling
+        std::random_device rd{};
+        std::default_random_engine rng{rd()};
+        int size_input = 1;
+        for (int m = 0; m < matrix_count; m++) size_input *= matrix_size;
+        std::uniform_int_distribution<int> batch_distribution(0, nb_batch - 1);
+        std::uniform_int_distribution<int> row_distribution(0, size_input - 1);
+
+        // batch elements contributing to each output
+        std::map<T const *, std::vector<int>> contributors;
+        for (int i = 0; i < nb_batch; i++) contributors[output_batched[i]].push_back(i);
+
+        for (Sample &sample : samples)
+        {
+            sample.batch_index = batch_distribution(rng);
+            sample.row         = row_distribution(rng);
+        }
+
+        // computes the reference values, the samples are independent
+        #pragma omp parallel for schedule(dynamic)
+        for (int s = 0; s < nb_samples; s++)
+        {
+            Sample &sample        = samples[s];
+            T const initial_value = output_batched[sample.batch_index][sample.row];
+            sample.expected       = initial_value;
+            sample.magnitude      = std::abs(static_cast<long double>(initial_value));
+            for (int const i : contributors.at(output_batched[sample.batch_index]))
+            {
+                long double magnitude;
+                sample.expected += kronmult_reference_entry(matrix_count, matrix_size,
+                                                            &matrix_list_batched[static_cast<size_t>(i) * matrix_count],
+                                                            matrix_stride, input_batched[i], sample.row, magnitude);
+                sample.magnitude += magnitude;
+            }
+        }
+    }
+
+    /*
+     * returns the maximum error on the sampled entries of the outputs
+     * errors are relative to the magnitude of the terms summed into each entry, which keeps them meaningful for
+     * entries that are close to zero after cancellations
+     */
+    T error(T const *const output_batched[]) const
+    {
+        long double const epsilon = 1e-300;
+        long double max_error     = 0.;
+        for (Sample const &sample : samples)
+        {
+            long double const value = output_batched[sample.batch_index][sample.row];
+            long double const error = std::abs(value - sample.expected) / (sample.magnitude + epsilon);
+            max_error               = std::max(max_error, error);
+        }
+        return static_cast<T>(max_error);
+    }
+
+    // number of sampled entries
+    int nb_samples() const { return static_cast<int>(samples.size()); }
+
+  private:
+    struct Sample
+    {
+        // a batch element whose output contains the entry
+        int batch_index;
+        // index of the entry in the output
+        int row;
+        // expected value of the entry
+        long double expected;
+        // sum of the absolute values of the terms of the entry
+        long double magnitude;
+    };
+
+    std::vector<Sample> samples;
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+
+/*
+ * elements of a sparse grid
+ * element e has level `levels[e*dimension+d]` and cell `cells[e*dimension+d]` in dimension d
+ */
+struct SparseGrid
+{
+    int dimension;
+    int level;
+    std::vector<int> levels;
+    std::vector<int> cells;
+
+    int nb_elements() const { return static_cast<int>(levels.size()) / dimension; }
+};
+
+/*
+ * builds a sparse grid: all the cells whose levels sum to at most `grid_level`
+ * (level 0 has a single cell and level l>0 has 2^(l-1) cells)
+ */
+SparseGrid make_sparse_grid(int const dimension, int const grid_level)
+{
+    SparseGrid grid{dimension, grid_level, {}, {}};
+    auto nb_cells = [](int const level) { return (level == 0) ? 1 : (1 << (level - 1)); };
+
+    // iterates on all tuples of levels
+    std::vector<int> levels(dimension, 0);
+    while(true)
+    {
+        int level_sum = 0;
+        for(int level : levels) level_sum += level;
+        if(level_sum <= grid_level)
+        {
+            // iterates on all the cells of these levels
+            std::vector<int> cells(dimension, 0);
+            while(true)
+            {
+                grid.levels.insert(grid.levels.end(), levels.begin(), levels.end());
+                grid.cells.insert(grid.cells.end(), cells.begin(), cells.end());
+                int d = 0;
+                while((d < dimension) and (++cells[d] >= nb_cells(levels[d]))) cells[d++] = 0;
+                if(d == dimension) break;
+            }
+        }
+        int d = 0;
+        while((d < dimension) and (++levels[d] > grid_level)) levels[d++] = 0;
+        if(d == dimension) break;
+    }
+
+    return grid;
+}
+
+/*
+ * returns true if the supports of elements `i` and `j` overlap in all dimensions, as is the case for local operators
+ */
+bool are_sparse_grid_elements_connected(SparseGrid const &grid, int const i, int const j)
+{
+    // support of a cell as an interval in units of the finest cells
+    auto support = [&](int const e, int const d, int &start, int &end) {
+        int const level = grid.levels[e * grid.dimension + d];
+        int const width = (level == 0) ? (1 << grid.level) : (1 << (grid.level - level + 1));
+        start = grid.cells[e * grid.dimension + d] * width;
+        end   = start + width;
+    };
+
+    for(int d = 0; d < grid.dimension; d++)
+    {
+        int start_i, end_i, start_j, end_j;
+        support(i, d, start_i, end_i);
+        support(j, d, start_j, end_j);
+        if((start_i >= end_j) or (start_j >= end_i)) return false;
+    }
+    return true;
+}
+
+/*
+ * stores in `row` the elements connected to element `i`, in increasing order
+ * costs one test per element of the grid, which lets you build a few rows of grids too large for a full connectivity
+ */
+void make_sparse_grid_connectivity_row(SparseGrid const &grid, int const i, std::vector<int> &row)
+{
+    row.clear();
+    int const nb_elements = grid.nb_elements();
+    for(int j = 0; j < nb_elements; j++)
+    {
+        if(are_sparse_grid_elements_connected(grid, i, j)) row.push_back(j);
+    }
+}
+
+/*
+ * builds the connectivity (in CSR format) of the elements of a sparse grid
+ * two elements are connected if their supports overlap in all dimensions, as is the case for local operators
+ */
+void make_sparse_grid_connectivity(SparseGrid const &grid, std::vector<int> &connectivity_starts,
+                                   std::vector<int> &connectivity)
+{
+    int const nb_elements = grid.nb_elements();
+    connectivity_starts.assign(1, 0);
+    connectivity.clear();
+    std::vector<int> row;
+    for(int i = 0; i < nb_elements; i++)
+    {
+        make_sparse_grid_connectivity_row(grid, i, row);
+        connectivity.insert(connectivity.end(), row.begin(), row.end());
+        connectivity_starts.push_back(static_cast<int>(connectivity.size()));
+    }
+}
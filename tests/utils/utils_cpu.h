@@ -1,6 +1,8 @@
 #pragma once
 #include "data_generation.h"
 #include <algorithm>
+#include <kronmult_arena.hpp>
+#include <memory>
 #include <vector>
 
 /*
@@ -13,20 +15,28 @@ class ArrayBatch
     // lets you access the data pointer directly
     T **rawPointer;
     size_t nb_arrays;
+    // if not null, the arrays are allocated in this arena (and released with it)
+    std::unique_ptr<kronmult_arena> arena;
 
     // creates an array of `nb_arrays` arrays of size `array_sizes` on device
+    // if `use_arena` is true, the arrays are allocated together in a `kronmult_arena` (aligned, with huge pages)
     ArrayBatch(size_t const array_sizes, size_t const nb_arrays_arg,
-               bool const should_initialize_data = false)
+               bool const should_initialize_data = false, bool const use_arena = false)
         : nb_arrays(nb_arrays_arg)
     {
         // random number generator for the data generation
         std::random_device rd{};
         std::default_random_engine rng{rd()};
         // allocating the arrays
+        if (use_arena)
+        {
+            size_t const array_bytes = kronmult_round_up(array_sizes * sizeof(T), KRONMULT_ALIGNMENT);
+            arena.reset(new kronmult_arena(std::max(size_t{1}, nb_arrays * array_bytes)));
+        }
         rawPointer = new T *[nb_arrays];
         for (unsigned int i = 0; i < nb_arrays; i++)
         {
-            rawPointer[i] = new T[array_sizes];
+            rawPointer[i] = arena ? arena->allocate<T>(array_sizes) : new T[array_sizes];
             if (should_initialize_data) fillArray(rawPointer[i], array_sizes, rng);
         }
     }
@@ -35,7 +45,7 @@ class ArrayBatch
     ~ArrayBatch()
     {
         // frees the batch elements
-        for (unsigned int i = 0; i < nb_arrays; i++)
+        for (unsigned int i = 0; (i < nb_arrays) and (not arena); i++)
         {
             delete[] rawPointer[i];
         }
@@ -57,22 +67,31 @@ class ArrayBatch_withRepetition
     size_t array_sizes;
     size_t nb_arrays;
     size_t nb_arrays_distinct;
+    // if not null, the arrays are allocated in this arena (and released with it)
+    std::unique_ptr<kronmult_arena> arena;
 
     // creates an array of `nb_arrays` arrays of size `array_sizes` on device
-    // contains only `nb_arrays_distinct` distinct elemnts
+    // contains only `nb_arrays_distinct` distinct elemnts (at most `nb_arrays`)
+    // if `use_arena` is true, the arrays are allocated together in a `kronmult_arena` (aligned, with huge pages)
     ArrayBatch_withRepetition(size_t const array_sizes_args, size_t const nb_arrays_args,
                               size_t const nb_arrays_distinct_arg = 5,
-                              bool const should_initialize_data   = false)
-        : array_sizes(array_sizes_args), nb_arrays(nb_arrays_args), nb_arrays_distinct(nb_arrays_distinct_arg)
+                              bool const should_initialize_data   = false, bool const use_arena = false)
+        : array_sizes(array_sizes_args), nb_arrays(nb_arrays_args),
+          nb_arrays_distinct(std::min(nb_arrays_distinct_arg, nb_arrays_args))
     {
         // random number generator for the data generation
         std::random_device rd{};
         std::default_random_engine rng{rd()};
         // allocating the arrays
+        if (use_arena)
+        {
+            size_t const array_bytes = kronmult_round_up(array_sizes * sizeof(T), KRONMULT_ALIGNMENT);
+            arena.reset(new kronmult_arena(std::max(size_t{1}, nb_arrays_distinct * array_bytes)));
+        }
         rawPointer = new T *[nb_arrays];
         for (unsigned int i = 0; i < nb_arrays_distinct; i++)
         {
-            rawPointer[i] = new T[array_sizes];
+            rawPointer[i] = arena ? arena->allocate<T>(array_sizes) : new T[array_sizes];
             if (should_initialize_data) fillArray(rawPointer[i], array_sizes, rng);
         }
         // allocates blocks of identical batch elements
@@ -85,7 +104,8 @@ class ArrayBatch_withRepetition
 
     // deep copy constructor
     ArrayBatch_withRepetition(ArrayBatch_withRepetition const &arraybatch)
-        : ArrayBatch_withRepetition(arraybatch.array_sizes, arraybatch.nb_arrays, arraybatch.nb_arrays_distinct)
+        : ArrayBatch_withRepetition(arraybatch.array_sizes, arraybatch.nb_arrays, arraybatch.nb_arrays_distinct,
+                                    false, arraybatch.arena != nullptr)
     {
         for (unsigned int i = 0; i < nb_arrays_distinct; i++)
         {
@@ -97,7 +117,7 @@ class ArrayBatch_withRepetition
     ~ArrayBatch_withRepetition()
     {
         // frees the batch elements
-        for (unsigned int i = 0; i < nb_arrays_distinct; i++)
+        for (unsigned int i = 0; (i < nb_arrays_distinct) and (not arena); i++)
         {
             delete[] rawPointer[i];
         }
@@ -117,7 +137,7 @@ class ArrayBatch_withRepetition
             T const *v2 = arraybatch.rawPointer[i];
             for (unsigned int j = 0; j < array_sizes; j++)
             {
-                T const dist = std::abs(v1[i] - v2[i]) / (std::abs(v1[i]) + epsilon);
+                T const dist = std::abs(v1[j] - v2[j]) / (std::abs(v1[j]) + epsilon);
                 if (dist > max_dist) max_dist = dist;
             }
         }
@@ -0,0 +1,77 @@
+#pragma once
+#include <map>
+#include <new>
+#include <omp.h>
+#include <vector>
+
+/*
+ * copy, on the default OpenMP device, of a batch of arrays allocated on the host
+ * with a proper constructor and destructor
+ *
+ * arrays that appear several times in the host batch (such as repeated outputs) are copied once and appear several
+ * times in the device batch, the batch of pointers being itself on the device
+ * when there is no device, `omp_target_alloc` falls back to host memory and the copy is a plain copy
+ */
+template<typename T>
+class TargetArrayBatch
+{
+  public:
+    // lets you access the device pointer directly
+    T **rawPointer;
+    size_t array_sizes;
+    size_t nb_arrays;
+
+    // copies the `nb_arrays` arrays of size `array_sizes` pointed to by `host_pointers` on the device
+    TargetArrayBatch(T *const host_pointers[], size_t const array_sizes_arg, size_t const nb_arrays_arg)
+        : array_sizes(array_sizes_arg), nb_arrays(nb_arrays_arg), device(omp_get_default_device()),
+          host(omp_get_initial_device())
+    {
+        std::vector<T *> device_pointers(nb_arrays);
+        for (size_t i = 0; i < nb_arrays; i++)
+        {
+            T *&device_pointer = copies[host_pointers[i]];
+            if (device_pointer == nullptr)
+            {
+                device_pointer = allocate<T>(array_sizes);
+                omp_target_memcpy(device_pointer, host_pointers[i], array_sizes * sizeof(T), 0, 0, device, host);
+            }
+            device_pointers[i] = device_pointer;
+        }
+        rawPointer = allocate<T *>(nb_arrays);
+        omp_target_memcpy(rawPointer, device_pointers.data(), nb_arrays * sizeof(T *), 0, 0, device, host);
+    }
+
+    TargetArrayBatch(TargetArrayBatch const &) = delete;
+    TargetArrayBatch &operator=(TargetArrayBatch const &) = delete;
+
+    // copies the device arrays back into the host arrays they were copied from
+    void copy_to_host() const
+    {
+        for (auto const &copy : copies)
+        {
+            omp_target_memcpy(copy.first, copy.second, array_sizes * sizeof(T), 0, 0, host, device);
+        }
+    }
+
+    // releases the memory
+    ~TargetArrayBatch()
+    {
+        for (auto const &copy : copies) omp_target_free(copy.second, device);
+        omp_target_free(rawPointer, device);
+    }
+
+  private:
+    int device;
+    int host;
+    // device copy of each distinct host array
+    std::map<T *, T *> copies;
+
+    // allocates `size` elements on the device, throws `std::bad_alloc` on failure
+    template<typename U>
+    U *allocate(size_t const size) const
+    {
+        void *const pointer = omp_target_alloc(std::max(size_t{1}, size * sizeof(U)), device);
+        if (pointer == nullptr) throw std::bad_alloc();
+        return static_cast<U *>(pointer);
+    }
+};
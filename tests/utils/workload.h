@@ -0,0 +1,175 @@
+#pragma once
+#include "sparse_grid.h"
+#include "utils_cpu.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <kronmult_sparse_grid.hpp>
+
+/*
+ * batch modeled on the ones that ASGarD builds for a sparse grid of the given degree, dimension and level
+ *
+ * unlike the random batches, whose few distinct outputs are assigned in contiguous blocks, the structure of the batch
+ * follows the sparse grid:
+ * - batch element (i,j) adds the contribution of element j to element i for every pair of connected elements (see
+ *   `make_sparse_grid_connectivity`), the batch elements being grouped by output element as in ASGarD
+ * - the outputs are the coefficients of the output elements, each one shared by all the elements of its neighborhood
+ * - the inputs are per batch element copies (kronmult uses them as workspaces) of the coefficients of the input
+ *   elements, `refill_inputs` restores them between two runs
+ * - the matrices are `degree` by `degree` blocks of one operator per dimension, indexed by the hierarchical
+ *   position of the elements in that dimension: they are shared by all the pairs of elements with the same levels
+ *   and cells in a dimension and their stride is that of the operator
+ *
+ * the whole grid rarely fits in memory: the output elements are taken in a (reproducible) random order, spread
+ * over the whole grid, until `max_batch_count` batch elements are reached (the last neighborhood being truncated)
+ */
+template<typename T>
+class SparseGridWorkload
+{
+  public:
+    int matrix_count;
+    int matrix_size;
+    int size_input;
+    // stride of the operators, and thus of the matrices
+    int matrix_stride;
+    int batch_count;
+    // number of elements of the sparse grid
+    int nb_elements;
+
+    // arrays with the layout expected by `kronmult_batched`
+    std::vector<T *> matrix_list_batched;
+    std::vector<T *> input_batched;
+    std::vector<T *> output_batched;
+    std::vector<T *> workspace_batched;
+
+    // number of distinct output elements and maximum number of batch elements sharing one of them
+    int nb_outputs;
+    int max_output_sharing;
+    // number of distinct input elements
+    int nb_inputs;
+    // number of distinct matrices
+    int nb_matrices;
+
+    SparseGridWorkload(int const degree, int const dimension, int const grid_level, int const max_batch_count,
+                       bool const should_initialize_data = false, bool const use_arena = false)
+        : matrix_count(dimension), matrix_size(degree), size_input(pow_int(degree, dimension)),
+          matrix_stride(degree << grid_level), batch_count(0), max_output_sharing(0)
+    {
+        SparseGrid const grid = make_sparse_grid(dimension, grid_level);
+        nb_elements           = grid.nb_elements();
+
+        // picks output elements, in a random order with a fixed seed, until the batch is full
+        std::vector<int> element_order(nb_elements);
+        std::iota(element_order.begin(), element_order.end(), 0);
+        std::default_random_engine rng{0};
+        std::shuffle(element_order.begin(), element_order.end(), rng);
+        std::vector<int> output_elements;
+        std::vector<int> batch_output_elements;
+        std::vector<int> batch_input_elements;
+        std::vector<int> row;
+        for (int e = 0; (e < nb_elements) and (batch_count < max_batch_count); e++)
+        {
+            int const i = element_order[e];
+            make_sparse_grid_connectivity_row(grid, i, row);
+            int const nb_connections = std::min(static_cast<int>(row.size()), max_batch_count - batch_count);
+            output_elements.push_back(i);
+            for (int k = 0; k < nb_connections; k++)
+            {
+                batch_output_elements.push_back(i);
+                batch_input_elements.push_back(row[k]);
+            }
+            batch_count += nb_connections;
+            max_output_sharing = std::max(max_output_sharing, nb_connections);
+        }
+        nb_outputs = static_cast<int>(output_elements.size());
+
+        // gives a slot to each distinct input and output element
+        std::vector<int> input_slots(nb_elements, -1);
+        std::vector<int> output_slots(nb_elements, -1);
+        nb_inputs = 0;
+        for (int const j : batch_input_elements)
+        {
+            if (input_slots[j] < 0) input_slots[j] = nb_inputs++;
+        }
+        for (int o = 0; o < nb_outputs; o++) output_slots[output_elements[o]] = o;
+
+        // allocates the problem
+        size_t const operator_size = static_cast<size_t>(matrix_stride) * matrix_stride;
+        operators.reset(new ArrayBatch<T>(operator_size, matrix_count, should_initialize_data, use_arena));
+        element_inputs.reset(new ArrayBatch<T>(size_input, nb_inputs, should_initialize_data, use_arena));
+        inputs.reset(new ArrayBatch<T>(size_input, batch_count, false, use_arena));
+        workspaces.reset(new ArrayBatch<T>(size_input, batch_count, false, use_arena));
+        outputs.reset(new ArrayBatch<T>(size_input, nb_outputs, should_initialize_data, use_arena));
+
+        // builds the batch
+        matrix_list_batched.resize(static_cast<size_t>(batch_count) * matrix_count);
+        input_batched.assign(inputs->rawPointer, inputs->rawPointer + batch_count);
+        workspace_batched.assign(workspaces->rawPointer, workspaces->rawPointer + batch_count);
+        output_batched.resize(batch_count);
+        input_sources.resize(batch_count);
+        for (int k = 0; k < batch_count; k++)
+        {
+            int const i       = batch_output_elements[k];
+            int const j       = batch_input_elements[k];
+            output_batched[k] = outputs->rawPointer[output_slots[i]];
+            input_sources[k]  = input_slots[j];
+            for (int d = 0; d < matrix_count; d++)
+            {
+                int const id      = i * dimension + d;
+                int const jd      = j * dimension + d;
+                int const index_i = kronmult_hierarchical_index(grid.levels[id], grid.cells[id]);
+                int const index_j = kronmult_hierarchical_index(grid.levels[jd], grid.cells[jd]);
+                size_t const row_offset    = static_cast<size_t>(index_i) * matrix_size;
+                size_t const column_offset = static_cast<size_t>(index_j) * matrix_size * matrix_stride;
+                matrix_list_batched[static_cast<size_t>(k) * matrix_count + d] =
+                    &operators->rawPointer[d][row_offset + column_offset];
+            }
+        }
+        std::vector<T *> distinct_matrices(matrix_list_batched);
+        std::sort(distinct_matrices.begin(), distinct_matrices.end());
+        nb_matrices = static_cast<int>(std::unique(distinct_matrices.begin(), distinct_matrices.end())
+                                       - distinct_matrices.begin());
+
+        refill_inputs();
+    }
+
+    /*
+     * copies the coefficients of the input elements into the inputs of the batch elements
+     * needed before each run, kronmult using the inputs as workspaces
+     */
+    void refill_inputs()
+    {
+        #pragma omp parallel for schedule(static)
+        for (int k = 0; k < batch_count; k++)
+        {
+            std::copy_n(element_inputs->rawPointer[input_sources[k]], size_input, input_batched[k]);
+        }
+    }
+
+    // displays the sharing statistics of the batch
+    void print_statistics(std::ostream &stream) const
+    {
+        stream << "sparse grid elements:" << nb_elements << " batch_count:" << batch_count
+               << " outputs:" << nb_outputs << " (" << static_cast<double>(batch_count) / nb_outputs
+               << " batch elements per output, at most " << max_output_sharing << ")"
+               << " inputs:" << nb_inputs << " (each used " << static_cast<double>(batch_count) / nb_inputs
+               << " times)"
+               << " matrices:" << nb_matrices << " (each used "
+               << static_cast<double>(batch_count) * matrix_count / nb_matrices << " times)" << std::endl;
+    }
+
+  private:
+    // one operator per dimension
+    std::unique_ptr<ArrayBatch<T>> operators;
+    // coefficients of the distinct input elements
+    std::unique_ptr<ArrayBatch<T>> element_inputs;
+    // inputs and workspaces of the batch elements, coefficients of the distinct output elements
+    std::unique_ptr<ArrayBatch<T>> inputs;
+    std::unique_ptr<ArrayBatch<T>> workspaces;
+    std::unique_ptr<ArrayBatch<T>> outputs;
+    // input element copied into the input of each batch element
+    std::vector<int> input_sources;
+};